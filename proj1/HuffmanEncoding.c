@@ -1,24 +1,103 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <dirent.h>
+#include <errno.h>
+#include "huff.h"
 
 #define MAX_CHARACTERS 256 // Assuming ASCII characters
+#define IO_BUFFER_SIZE (1 << 20) // Bytes read or written per stdio call
+#define DECODE_TABLE_BITS 11 // Input bits resolved by one probe of a decode table level
+#define FILE_MAGIC "HUFF" // First bytes of a compressed file
+#define FORMAT_VERSION 1 // Container layout written by this program
+#define TABLE_MAGIC "HUFT" // First bytes of a trained code table file
+#define INDEX_MAGIC "HUFI" // Last bytes of a compressed file with a block index
+#define ARCHIVE_MAGIC "HUFA" // First and last bytes of an archive (-A)
+#define BLOCK_SIZE (1 << 20) // Input bytes per container block
+#define MAX_BLOCK_SIZE (64 << 20) // Upper limit for -B
+#define STREAM_BLOCK_SIZE (128 << 10) // Input bytes per block in streaming mode (-s)
+#define INTERLEAVED_STREAMS 4 // Sub-streams of an interleaved block (-x), character i goes to stream i % 4
+#define MAX_THREADS 256 // Upper limit for -t
+#define MAX_LIMITED_LENGTH 32 // Upper limit for -L
+#define ANS_TABLE_LOG 12 // tANS (-a) states per table as a power of two
+#define ANS_TABLE_SIZE (1 << ANS_TABLE_LOG) // Normalized character counts add up to this
+#define CONTEXT_MAX_LENGTH 16 // Longest code of an order-1 (-c) table unless -L sets another limit
+
+// Container layout (all integers little endian):
+//   header: magic "HUFF", u8 version, u8 flags, u32 block size, u64 original size,
+//           u16 n, then n code lengths (u8) for characters 0..n-1 (0 = character absent),
+//           or with FLAG_STATIC_TABLE the u32 id of a trained table file instead of the lengths,
+//           or with FLAG_ANS u16 n, then n normalized counts (u16) adding up to ANS_TABLE_SIZE;
+//           with FLAG_ORDER1 the lengths are the fallback table, followed by a 32 byte bitmap of the
+//           previous characters that have their own table and then their code lengths in order
+//   blocks: u8 kind, u32 original bytes, u32 payload bits, [own code lengths as in the header],
+//           then the payload padded to a whole byte
+//           interleaved payloads start with a jump table of 4 u32 sub-stream bit counts, followed by
+//           the 4 sub-streams, each padded to a whole byte
+//           order-1 payloads code each character with the table of the character before it, the
+//           first character of a block with the table of character 0
+//           tANS payloads start with the final encoder state (ANS_TABLE_LOG bits), followed by the
+//           bits of each character in input order
+//   end:    a block of kind BLOCK_END with zero bytes and bits
+//   index:  with FLAG_INDEXED, one entry per block (u64 original offset, u64 file offset of the block
+//           header; blocks are byte aligned so this is the compressed bit offset / 8), then a trailer of
+//           u32 entry count, u64 file offset of the first entry and magic "HUFI" ending the file
+// Codes are canonical: for the same code lengths every encoder and decoder assigns the same codes.
+enum BlockKind {
+    BLOCK_END = 0,
+    BLOCK_HUFFMAN = 1,      // Payload coded with the code lengths from the header
+    BLOCK_HUFFMAN_TABLE = 2,   // Payload coded with code lengths stored in the block itself
+    BLOCK_HUFFMAN_X4 = 3,      // Interleaved payload, code lengths from the header
+    BLOCK_HUFFMAN_X4_TABLE = 4, // Interleaved payload, code lengths stored in the block itself
+    BLOCK_ANS = 5,             // tANS payload, normalized counts from the header
+    BLOCK_ANS_TABLE = 6,       // tANS payload, normalized counts stored in the block itself
+    BLOCK_HUFFMAN_ORDER1 = 7   // Payload coded with the order-1 tables from the header
+};
+
+// Header flags
+#define FLAG_STREAMED 0x01 // Written from a stream: original size is unknown (0), every block has its own table
+#define FLAG_STATIC_TABLE 0x02 // Coded with a trained table that is referenced by id (-b) instead of stored
+#define FLAG_INDEXED 0x04 // A block index follows the end block, for random access (--range)
+#define FLAG_ANS 0x08 // Coded with tANS (-a): the header holds normalized counts instead of code lengths
+#define FLAG_ORDER1 0x10 // Coded with order-1 tables (-c) that follow the fallback code lengths in the header
+
+// Phases of a run, timed for the profile line of -P
+enum Phase {
+    PHASE_READ,      // Reading the input (or the container header and payloads)
+    PHASE_HISTOGRAM, // Counting characters
+    PHASE_TREE,      // Building the Huffman tree or the package-merge code lengths
+    PHASE_CODES,     // Assigning codes and building encode and decode tables
+    PHASE_ENCODE,    // Encoding blocks
+    PHASE_DECODE,    // Decoding blocks
+    PHASE_WRITE,     // Writing the output
+    PHASE_COUNT
+};
+
+// Archive layout (-A): magic "HUFA", u8 version, then the members in the order they finished, each a
+// complete container as above; then the central directory with one entry per member (u16 name length,
+// the name, u64 original size, u64 offset and u64 size of the member), then a trailer of u32 member
+// count, u64 offset of the directory and magic "HUFA" ending the file
+
+// Trained table file: magic "HUFT", u8 version, u32 id, then code lengths as in the container header
 
 // Struct to store character and frequency pairs
 struct CharFrequency {
     char character;
-    int frequency;
+    uint64_t frequency;
 };
 
-// Function to compare two CharFrequency structs for sorting
-int compareCharFrequency(const void *a, const void *b) {
-    return ((struct CharFrequency *)b)->frequency - ((struct CharFrequency *)a)->frequency;
-}
-
 // Struct to represent a node in the Huffman tree
 struct Node {
     char character;
-    int frequency;
+    uint64_t frequency;
     struct Node *left;
     struct Node *right;
 };
@@ -36,8 +115,186 @@ struct HuffmanCode {
     char *code;
 };
 
+// Struct to pack variable length codes into a 64-bit accumulator and a large output buffer
+struct BitWriter {
+    uint64_t accumulator; // Pending bits, the newest bit is the least significant
+    int count;            // Number of pending bits in the accumulator (always < 32 between calls)
+    unsigned char *buffer;
+    size_t position;
+    size_t capacity;
+    FILE *file;
+};
+
+// Struct to read a bitstream most significant bit first through a 64-bit buffer
+struct BitReader {
+    const unsigned char *data;
+    size_t size;
+    size_t position; // Next byte of data to load into the buffer
+    uint64_t bits;   // Buffered bits, the next bit is the most significant
+    int count;       // Number of valid bits in the buffer
+};
+
+// Struct for one slot of a multi-level decode table
+struct DecodeEntry {
+    uint32_t value;    // Character for a leaf entry, index of the next level for a link entry
+    uint8_t length;    // Bits consumed at this level (0 marks a slot no code reaches)
+    uint8_t next_bits; // Index bits of the next level, 0 for a leaf entry
+};
+
+// Struct to store all levels of a decode table in one flat array
+struct DecodeTable {
+    struct DecodeEntry *entries;
+    size_t size;
+    size_t capacity;
+    int root_bits; // Index bits of the first level, which starts at entry 0
+};
+
+// Struct for the tANS encoder of one set of normalized counts
+struct AnsEncoder {
+    uint16_t counts[MAX_CHARACTERS];
+    int start[MAX_CHARACTERS];       // First entry of each character in 'states'
+    uint8_t shift[MAX_CHARACTERS];   // ANS_TABLE_LOG - floor(log2(count)), the most bits a character can emit
+    uint16_t states[ANS_TABLE_SIZE]; // Next states of every character, in the order of its occurrences
+};
+
+// Struct for one state of a tANS decode table
+struct AnsDecodeEntry {
+    uint16_t base;  // Next state before the bits read for it are added
+    uint8_t symbol; // Character decoded in this state
+    uint8_t bits;   // Bits read to form the next state
+};
+
+// Struct to hold the whole input in memory, mapped for regular files and read for pipes
+struct InputData {
+    const unsigned char *data;
+    size_t size;
+    int mapped; // 1 if data is mapped from the file, 0 if it was read into a malloc'd buffer
+};
+
+// Struct to hold the command line settings of a compression run
+struct CompressOptions {
+    int raw;     // -r: write the bare bitstream of the tree codes without the container
+    int threads; // -t: threads used for the histogram and for encoding blocks
+    int stream;  // -s: encode fixed size blocks as they arrive, each with its own tree
+    int max_length; // -L: longest code allowed (package-merge), 0 keeps the plain Huffman tree
+    int interleave; // -x: split every block into 4 interleaved sub-streams
+    size_t block_size; // -B: input bytes per block, which is also the granularity of the block index
+    int ans;        // -a: code with tANS instead of Huffman codes
+    int order1;     // -c: code every character with a table chosen by the character before it
+};
+
+// Struct for the tables of order-1 coding: frequent contexts (previous characters) get their own
+// table, the rest share one fallback table built from their combined counts
+struct ContextCodes {
+    unsigned char own[MAX_CHARACTERS]; // 1 if the context has its own table
+    unsigned char lengths[MAX_CHARACTERS + 1][MAX_CHARACTERS]; // Entry MAX_CHARACTERS is the fallback table
+    struct BitCode bitCodes[MAX_CHARACTERS + 1][MAX_CHARACTERS];
+    const struct BitCode *codes_of[MAX_CHARACTERS]; // Table used after each character
+    int tables;            // Contexts with their own table
+    uint64_t order0_bits;  // Payload bits the input would take with the order-0 codes
+    uint64_t order1_bits;  // Payload bits with the order-1 tables
+};
+
+// Struct to collect the block index while a container is written
+struct BlockIndex {
+    uint64_t *entries; // Pairs of (original offset, file offset) for every block
+    size_t count;
+    size_t capacity;
+    uint64_t original_position; // Original bytes written so far
+    uint64_t file_position;     // Container bytes written so far (works for pipes, where ftell does not)
+};
+
+// Struct to hold the state of a container being decoded block by block
+struct Decoder {
+    FILE *input_file;
+    const char *input_filename;
+    int flags;
+    uint32_t block_size;
+    uint64_t original_size;
+    int has_table;              // The header (or a trained table) provides the code lengths
+    struct DecodeTable table;       // Table of the header code lengths
+    struct DecodeTable block_table; // Table of the last block that brought its own code lengths
+    struct AnsDecodeEntry ans_table[ANS_TABLE_SIZE];       // tANS table of the header counts
+    struct AnsDecodeEntry ans_block_table[ANS_TABLE_SIZE]; // tANS table of the last block with its own counts
+    struct DecodeTable *context_tables; // Order-1 tables, entry MAX_CHARACTERS is the fallback
+    const struct DecodeTable *context_of[MAX_CHARACTERS];
+    unsigned char *payload;
+    size_t payload_capacity;
+    unsigned char *output;      // Characters of the last decoded block
+    size_t output_capacity;
+};
+
+// Struct for one member of an archive
+struct ArchiveMember {
+    char *name;             // Path of the input file, and of the member relative to the extraction directory
+    uint64_t original_size;
+    uint64_t offset;        // Position of the member's container in the archive
+    uint64_t size;          // Bytes of the member's container
+};
+
+// Struct shared by the threads that create or extract the members of an archive
+struct ArchivePool {
+    struct ArchiveMember *members;
+    int count;
+    int next;                // Next member to take
+    int failures;
+    pthread_mutex_t lock;    // Protects next, failures and the archive file position
+    const char *archive_filename;
+    FILE *archive_file;      // Output while creating (each extracting thread opens its own)
+    uint64_t position;       // Archive bytes written so far
+    const char *directory;   // Extraction directory
+    const struct CompressOptions *options;
+};
+
+// Struct for one thread's share of a parallel histogram
+struct HistogramJob {
+    const unsigned char *data;
+    size_t size;
+    struct CharFrequency frequencies[MAX_CHARACTERS];
+};
+
+// Struct for one block encoded by a worker thread
+struct EncodeJob {
+    const struct BitCode *bitCodes;
+    const unsigned char *data;
+    size_t size;
+    struct BitWriter writer; // In-memory writer that keeps its buffer between blocks
+    uint32_t payload_bits;
+    int interleave;
+    struct BitWriter streams[INTERLEAVED_STREAMS]; // Sub-stream writers of an interleaved block
+    const struct AnsEncoder *ans; // Set to code the block with tANS instead of 'bitCodes'
+    const struct BitCode *const *context_codes; // Set to code the block with order-1 tables instead of 'bitCodes'
+    uint32_t *ans_codes;          // Bits of each character (low 16) and their count (high 16)
+    size_t ans_capacity;
+};
+
+#ifndef HUFF_NO_MAIN
+// Seconds spent in each phase, and the time the current phase started (per thread, -P reports the main thread)
+static const char *phase_names[PHASE_COUNT] = { "read", "histogram", "tree", "codes", "encode", "decode", "write" };
+static __thread double phase_seconds[PHASE_COUNT];
+static __thread struct timespec phase_mark;
+
+// Function to charge the time since the last mark to a phase and start the next one
+static void endPhase(enum Phase phase) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    phase_seconds[phase] += (now.tv_sec - phase_mark.tv_sec) + (now.tv_nsec - phase_mark.tv_nsec) / 1e9;
+    phase_mark = now;
+}
+
+// Function to print the phase times and the peak memory of the run as one JSON line on standard error
+static void printProfile(const char *mode, double seconds) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(stderr, "{\"mode\": \"%s\", \"seconds\": %.6f, \"peak_rss_kb\": %ld, \"phases\": {", mode, seconds, usage.ru_maxrss);
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        fprintf(stderr, "%s\"%s\": %.6f", phase > 0 ? ", " : "", phase_names[phase], phase_seconds[phase]);
+    }
+    fprintf(stderr, "}}\n");
+}
+
 // Function to create a new node
-struct Node *createNode(char character, int frequency) {
+static struct Node *createNode(char character, uint64_t frequency) {
     struct Node *node = (struct Node *)malloc(sizeof(struct Node));
     if (node) {
         node->character = character;
@@ -49,7 +306,7 @@ struct Node *createNode(char character, int frequency) {
 }
 
 // Function to create a Min Heap
-struct MinHeap *createMinHeap(int capacity) {
+static struct MinHeap *createMinHeap(int capacity) {
     struct MinHeap *minHeap = (struct MinHeap *)malloc(sizeof(struct MinHeap));
     if (minHeap) {
         minHeap->size = 0;
@@ -60,42 +317,37 @@ struct MinHeap *createMinHeap(int capacity) {
 }
 
 // Function to swap two nodes in the Min Heap
-void swapNodes(struct Node **a, struct Node **b) {
+static void swapNodes(struct Node **a, struct Node **b) {
     struct Node *temp = *a;
     *a = *b;
     *b = temp;
 }
 
 // Function to heapify a subtree with the root at given index
-void minHeapify(struct MinHeap *minHeap, int idx) {
-    int smallest = idx;
-    int left = 2 * idx + 1;
-    int right = 2 * idx + 2;
+static void minHeapify(struct MinHeap *minHeap, int idx) {
+    for (;;) {
+        int smallest = idx;
+        int left = 2 * idx + 1;
+        int right = 2 * idx + 2;
 
-    if (left < minHeap->size && minHeap->array[left]->frequency < minHeap->array[smallest]->frequency) {
-        smallest = left;
-    }
+        if (left < minHeap->size && minHeap->array[left]->frequency < minHeap->array[smallest]->frequency) {
+            smallest = left;
+        }
 
-    if (right < minHeap->size && minHeap->array[right]->frequency < minHeap->array[smallest]->frequency) {
-        smallest = right;
-    }
+        if (right < minHeap->size && minHeap->array[right]->frequency < minHeap->array[smallest]->frequency) {
+            smallest = right;
+        }
 
-    if (smallest != idx) {
+        if (smallest == idx) {
+            return;
+        }
         swapNodes(&minHeap->array[idx], &minHeap->array[smallest]);
-        minHeapify(minHeap, smallest);
-    }
-}
-
-// Function to build a Min Heap from an array of nodes
-void buildMinHeap(struct MinHeap *minHeap) {
-    int n = minHeap->size - 1;
-    for (int i = (n - 1) / 2; i >= 0; i--) {
-        minHeapify(minHeap, i);
+        idx = smallest;
     }
 }
 
 // Function to extract the node with the lowest frequency from the Min Heap
-struct Node *extractMin(struct MinHeap *minHeap) {
+static struct Node *extractMin(struct MinHeap *minHeap) {
     struct Node *minNode = minHeap->array[0];
     minHeap->array[0] = minHeap->array[minHeap->size - 1];
     minHeap->size--;
@@ -104,7 +356,7 @@ struct Node *extractMin(struct MinHeap *minHeap) {
 }
 
 // Function to insert a node into the Min Heap
-void insertNode(struct MinHeap *minHeap, struct Node *node) {
+static void insertNode(struct MinHeap *minHeap, struct Node *node) {
     minHeap->size++;
     int i = minHeap->size - 1;
     while (i > 0 && node->frequency < minHeap->array[(i - 1) / 2]->frequency) {
@@ -115,7 +367,7 @@ void insertNode(struct MinHeap *minHeap, struct Node *node) {
 }
 
 // Function to build a Huffman tree from character frequencies
-struct Node *buildHuffmanTree(struct CharFrequency *char_frequencies) {
+static struct Node *buildHuffmanTree(struct CharFrequency *char_frequencies) {
     struct MinHeap *minHeap = createMinHeap(MAX_CHARACTERS);
 
     // Create leaf nodes and insert them into the Min Heap
@@ -140,12 +392,37 @@ struct Node *buildHuffmanTree(struct CharFrequency *char_frequencies) {
     }
 
     // The remaining node in the Min Heap is the root of the Huffman tree
-    return extractMin(minHeap);
+    struct Node *root = extractMin(minHeap);
+    free(minHeap->array);
+    free(minHeap);
+    return root;
+}
+
+// Function to release every node of a Huffman tree
+static void freeHuffmanTree(struct Node *root) {
+    if (root != NULL) {
+        freeHuffmanTree(root->left);
+        freeHuffmanTree(root->right);
+        free(root);
+    }
+}
+
+// Function to release the code strings made by assignHuffmanCodes
+static void freeHuffmanCodes(struct HuffmanCode *huffmanCodes) {
+    for (int i = 0; i < MAX_CHARACTERS; i++) {
+        free(huffmanCodes[i].code);
+        huffmanCodes[i].code = NULL;
+    }
 }
 
 // Function to traverse the Huffman tree and assign binary codes
-void assignHuffmanCodes(struct Node *root, char *code, int depth, struct HuffmanCode *huffmanCodes) {
+static void assignHuffmanCodes(struct Node *root, char *code, int depth, struct HuffmanCode *huffmanCodes) {
     if (root->left == NULL && root->right == NULL) {
+        // A tree with a single character still needs a one bit code to be decodable
+        if (depth == 0) {
+            code[0] = '0';
+            code[1] = '\0';
+        }
         // Leaf node, assign the code
         huffmanCodes[(unsigned char)root->character].character = (char)root->character;
         huffmanCodes[(unsigned char)root->character].code = strdup(code);
@@ -164,127 +441,477 @@ void assignHuffmanCodes(struct Node *root, char *code, int depth, struct Huffman
     }
 }
 
-int main(int argc, char *argv[]) {
-    char *input_filename = NULL;
-    char *output_filename = NULL;
-
-    // Check if the correct number of command line arguments is provided
-    if (argc != 5) {
-        printf("Usage: %s -i input_filename -o output_filename\n", argv[0]);
-        return 1; // Exit with an error code
+// Function to convert the '0'/'1' code strings into (bits, length) pairs
+static void buildBitCodes(struct HuffmanCode *huffmanCodes, struct BitCode *bitCodes) {
+    for (int i = 0; i < MAX_CHARACTERS; i++) {
+        bitCodes[i].bits = 0;
+        bitCodes[i].length = 0;
+        if (huffmanCodes[i].code == NULL) {
+            continue;
+        }
+        for (int j = 0; huffmanCodes[i].code[j] != '\0'; j++) {
+            bitCodes[i].bits = (bitCodes[i].bits << 1) | (huffmanCodes[i].code[j] == '1');
+            bitCodes[i].length++;
+        }
     }
+}
 
-    // Parse command line arguments
-    for (int i = 1; i < argc; i++) {
-        if (strcmp(argv[i], "-i") == 0) {
-            if (i + 1 < argc) {
-                input_filename = argv[i + 1];
-                i++; // Skip the next argument since it's the input filename
-            } else {
-                printf("Error: Missing input filename\n");
-                return 1; // Exit with an error code
+// Function to set up a bit writer that flushes into the given file
+static int initBitWriter(struct BitWriter *writer, FILE *file) {
+    writer->accumulator = 0;
+    writer->count = 0;
+    writer->position = 0;
+    writer->capacity = IO_BUFFER_SIZE;
+    writer->file = file;
+    writer->buffer = (unsigned char *)malloc(writer->capacity);
+    return writer->buffer != NULL ? 0 : -1;
+}
+#endif
+
+// Function to write the buffered bytes to the output file, or grow the buffer of an in-memory writer
+static void flushBitWriter(struct BitWriter *writer) {
+    if (writer->file == NULL) {
+        if (writer->capacity - writer->position < 8) {
+            unsigned char *buffer = (unsigned char *)realloc(writer->buffer, writer->capacity * 2);
+            if (buffer == NULL) {
+                printf("Error: Out of memory\n");
+                exit(1);
             }
-        } else if (strcmp(argv[i], "-o") == 0) {
-            if (i + 1 < argc) {
-                output_filename = argv[i + 1];
-                i++; // Skip the next argument since it's the output filename
-            } else {
-                printf("Error: Missing output filename\n");
-                return 1; // Exit with an error code
+            writer->buffer = buffer;
+            writer->capacity *= 2;
+        }
+    } else if (writer->position > 0) {
+        fwrite(writer->buffer, 1, writer->position, writer->file);
+        writer->position = 0;
+    }
+}
+
+// Function to append a code of up to 32 bits to the accumulator, flushing whole 32-bit words
+static inline void putBits(struct BitWriter *writer, uint64_t bits, int length) {
+    writer->accumulator = (writer->accumulator << length) | bits;
+    writer->count += length;
+    if (writer->count >= 32) {
+        if (writer->capacity - writer->position < 4) {
+            flushBitWriter(writer);
+        }
+        uint32_t word = (uint32_t)(writer->accumulator >> (writer->count - 32));
+        unsigned char *out = writer->buffer + writer->position;
+        out[0] = (unsigned char)(word >> 24);
+        out[1] = (unsigned char)(word >> 16);
+        out[2] = (unsigned char)(word >> 8);
+        out[3] = (unsigned char)word;
+        writer->position += 4;
+        writer->count -= 32;
+    }
+}
+
+// Function to append a code of any length (codes longer than 32 bits are split in two)
+static inline void writeBits(struct BitWriter *writer, uint64_t bits, int length) {
+    if (length > 32) {
+        putBits(writer, bits >> 32, length - 32);
+        bits &= 0xFFFFFFFFu;
+        length = 32;
+    }
+    putBits(writer, bits, length);
+}
+
+// Function to write the remaining bits, padding the last byte with zeros
+static void alignBitWriter(struct BitWriter *writer) {
+    while (writer->count > 0) {
+        if (writer->position == writer->capacity) {
+            flushBitWriter(writer);
+        }
+        int shift = writer->count - 8;
+        unsigned char byte = shift >= 0 ? (unsigned char)(writer->accumulator >> shift)
+                                        : (unsigned char)(writer->accumulator << -shift);
+        writer->buffer[writer->position++] = byte;
+        writer->count = shift > 0 ? shift : 0;
+    }
+}
+
+#ifndef HUFF_NO_MAIN
+// Function to start a new block in an in-memory writer
+static void resetBitWriter(struct BitWriter *writer) {
+    writer->accumulator = 0;
+    writer->count = 0;
+    writer->position = 0;
+}
+
+// Function to write the remaining bits and release the buffer
+static void finishBitWriter(struct BitWriter *writer) {
+    alignBitWriter(writer);
+    flushBitWriter(writer);
+    free(writer->buffer);
+    writer->buffer = NULL;
+}
+#endif
+
+// Function to encode a block of input bytes with the (bits, length) table
+static void encodeBlock(struct BitWriter *writer, const struct BitCode *bitCodes, const unsigned char *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        const struct BitCode *code = &bitCodes[data[i]];
+        writeBits(writer, code->bits, code->length);
+    }
+}
+
+// Function to assign canonical codes from code lengths: shorter codes first, ties in character order
+static int buildCanonicalCodes(const unsigned char *lengths, struct BitCode *bitCodes) {
+    int length_counts[65] = { 0 };
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        if (lengths[c] > 64) {
+            return -1;
+        }
+        length_counts[lengths[c]]++;
+    }
+    length_counts[0] = 0;
+
+    // Each length starts right after the last code of the previous length, one bit longer
+    uint64_t next_code[65];
+    uint64_t code = 0;
+    int64_t available = 1; // Unused codes of the current length (Kraft inequality check)
+    for (int length = 1; length <= 64; length++) {
+        code = (code + length_counts[length - 1]) << 1;
+        next_code[length] = code;
+        available = available * 2 - length_counts[length];
+        if (available < 0) {
+            return -1; // Over-subscribed lengths cannot form a prefix code
+        }
+        if (available > MAX_CHARACTERS) {
+            available = MAX_CHARACTERS + 1; // Enough for any remaining characters
+        }
+    }
+
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        bitCodes[c].length = lengths[c];
+        bitCodes[c].bits = lengths[c] > 0 ? next_code[lengths[c]]++ : 0;
+    }
+    return 0;
+}
+
+#ifndef HUFF_NO_MAIN
+// Function to make room for 'count' more entries in a decode table
+static int growDecodeTable(struct DecodeTable *table, size_t count) {
+    if (table->size + count > table->capacity) {
+        size_t capacity = table->capacity * 2;
+        while (capacity < table->size + count) {
+            capacity *= 2;
+        }
+        struct DecodeEntry *entries = (struct DecodeEntry *)realloc(table->entries, capacity * sizeof(struct DecodeEntry));
+        if (entries == NULL) {
+            return -1;
+        }
+        table->entries = entries;
+        table->capacity = capacity;
+    }
+    memset(table->entries + table->size, 0, count * sizeof(struct DecodeEntry));
+    table->size += count;
+    return 0;
+}
+
+// Function to fill the level at 'base' for all codes that start with the given prefix
+static int fillDecodeLevel(struct DecodeTable *table, const struct BitCode *bitCodes, uint64_t prefix, int prefix_length, size_t base, int bits) {
+    int longest[1 << DECODE_TABLE_BITS]; // Longest remaining code length behind each link slot
+    memset(longest, 0, sizeof(int) << bits);
+
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        int remaining = bitCodes[c].length - prefix_length;
+        if (remaining <= 0 || (bitCodes[c].bits >> remaining) != prefix) {
+            continue;
+        }
+        uint64_t suffix = bitCodes[c].bits & ((UINT64_C(1) << remaining) - 1);
+        if (remaining <= bits) {
+            // The code ends at this level, so every slot starting with its suffix decodes to it
+            size_t first = (size_t)(suffix << (bits - remaining));
+            for (size_t j = 0; j < ((size_t)1 << (bits - remaining)); j++) {
+                table->entries[base + first + j].value = c;
+                table->entries[base + first + j].length = remaining;
+                table->entries[base + first + j].next_bits = 0;
             }
         } else {
-            printf("Error: Invalid argument '%s'\n", argv[i]);
-            return 1; // Exit with an error code
+            size_t slot = (size_t)(suffix >> (remaining - bits));
+            if (remaining - bits > longest[slot]) {
+                longest[slot] = remaining - bits;
+            }
         }
     }
 
-    // Open the input file for reading
-    FILE *input_file = fopen(input_filename, "r");
-    if (input_file == NULL) {
-        perror("Error opening input file");
-        return 1; // Exit with an error code
+    // Codes longer than this level continue in a next level table linked from their slot
+    for (size_t slot = 0; slot < ((size_t)1 << bits); slot++) {
+        if (longest[slot] == 0) {
+            continue;
+        }
+        int next_bits = longest[slot] < DECODE_TABLE_BITS ? longest[slot] : DECODE_TABLE_BITS;
+        size_t next_base = table->size;
+        if (growDecodeTable(table, (size_t)1 << next_bits) != 0) {
+            return -1;
+        }
+        table->entries[base + slot].value = (uint32_t)next_base;
+        table->entries[base + slot].length = bits;
+        table->entries[base + slot].next_bits = next_bits;
+        if (fillDecodeLevel(table, bitCodes, (prefix << bits) | slot, prefix_length + bits, next_base, next_bits) != 0) {
+            return -1;
+        }
     }
+    return 0;
+}
 
-    // Initialize an array of CharFrequency structs to store character frequencies
-    struct CharFrequency char_frequencies[MAX_CHARACTERS];
-    for (int i = 0; i < MAX_CHARACTERS; i++) {
-        char_frequencies[i].character = i;
-        char_frequencies[i].frequency = 0;
+// Function to build the multi-level decode table for a set of codes
+static int buildDecodeTable(struct DecodeTable *table, const struct BitCode *bitCodes) {
+    int max_length = 0;
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        if (bitCodes[c].length > max_length) {
+            max_length = bitCodes[c].length;
+        }
     }
+    if (max_length == 0 || max_length > 64) {
+        return -1;
+    }
+
+    table->root_bits = max_length < DECODE_TABLE_BITS ? max_length : DECODE_TABLE_BITS;
+    table->size = 0;
+    table->capacity = (size_t)1 << DECODE_TABLE_BITS;
+    table->entries = (struct DecodeEntry *)malloc(table->capacity * sizeof(struct DecodeEntry));
+    if (table->entries == NULL || growDecodeTable(table, (size_t)1 << table->root_bits) != 0) {
+        return -1;
+    }
+    return fillDecodeLevel(table, bitCodes, 0, 0, 0, table->root_bits);
+}
+#endif
+
+// Function to start reading a bitstream from memory
+static void initBitReader(struct BitReader *reader, const unsigned char *data, size_t size) {
+    reader->data = data;
+    reader->size = size;
+    reader->position = 0;
+    reader->bits = 0;
+    reader->count = 0;
+}
+
+// Function to top the buffer up near the end of the data, zeros are shifted in past the end
+static void refillBitReaderTail(struct BitReader *reader) {
+    while (reader->count <= 56) {
+        uint64_t byte = reader->position < reader->size ? reader->data[reader->position] : 0;
+        reader->bits |= byte << (56 - reader->count);
+        reader->position++;
+        reader->count += 8;
+    }
+}
+
+// Function to top the buffer up to at least 57 bits
+static inline void refillBitReader(struct BitReader *reader) {
+    if (reader->position + 8 <= reader->size) {
+        const unsigned char *in = reader->data + reader->position;
+        uint64_t word = ((uint64_t)in[0] << 56) | ((uint64_t)in[1] << 48) | ((uint64_t)in[2] << 40) | ((uint64_t)in[3] << 32) |
+                        ((uint64_t)in[4] << 24) | ((uint64_t)in[5] << 16) | ((uint64_t)in[6] << 8) | (uint64_t)in[7];
+        reader->bits |= word >> reader->count;
+        reader->position += (63 - reader->count) >> 3;
+        reader->count |= 56;
+    } else {
+        refillBitReaderTail(reader);
+    }
+}
 
-    // Read characters from the input file and update their frequencies
-    int c;
-    while ((c = fgetc(input_file)) != EOF) {
-        if (c >= 0 && c < MAX_CHARACTERS) {
-            char_frequencies[c].frequency++;
+#ifndef HUFF_NO_MAIN
+// Function to follow the linked levels of a code longer than the first level (-1 if no code matches)
+static int decodeLongSymbol(struct BitReader *reader, const struct DecodeEntry *entries, const struct DecodeEntry *entry) {
+    while (entry->next_bits != 0) {
+        reader->bits <<= entry->length;
+        reader->count -= entry->length;
+        if (reader->count < 32) {
+            refillBitReader(reader);
         }
+        entry = &entries[entry->value + (reader->bits >> (64 - entry->next_bits))];
+    }
+    if (entry->length == 0) {
+        return -1;
     }
+    reader->bits <<= entry->length;
+    reader->count -= entry->length;
+    return (int)entry->value;
+}
 
-    // Build the Huffman tree
-    struct Node *huffmanRoot = buildHuffmanTree(char_frequencies);
+// Function to decode one character, one table probe for codes up to DECODE_TABLE_BITS long (-1 if no code matches)
+static inline int decodeSymbol(struct BitReader *reader, const struct DecodeEntry *entries, int root_bits) {
+    if (reader->count < 32) {
+        refillBitReader(reader);
+    }
+    const struct DecodeEntry *entry = &entries[reader->bits >> (64 - root_bits)];
+    if (entry->next_bits != 0 || entry->length == 0) {
+        return decodeLongSymbol(reader, entries, entry);
+    }
+    reader->bits <<= entry->length;
+    reader->count -= entry->length;
+    return (int)entry->value;
+}
 
-    // Initialize an array of HuffmanCode structs to store Huffman codes
-    struct HuffmanCode huffmanCodes[MAX_CHARACTERS];
-    for (int i = 0; i < 256; i++) {
-        huffmanCodes[i].character = i;
-        huffmanCodes[i].code = NULL;
+// Function to decode 'length' characters from a single bitstream
+static int decodeBlock(struct BitReader *reader, const struct DecodeTable *table, unsigned char *output, size_t length) {
+    struct BitReader local = *reader; // A local copy stays in registers, stores to output cannot alias it
+    for (size_t i = 0; i < length; i++) {
+        int c = decodeSymbol(&local, table->entries, table->root_bits);
+        if (c < 0) {
+            return -1; // No code matches the input bits
+        }
+        output[i] = (unsigned char)c;
     }
+    *reader = local;
+    return 0;
+}
 
-    // Assign Huffman codes to characters
-    char code[MAX_CHARACTERS];
-    code[0] = '\0';
-    assignHuffmanCodes(huffmanRoot, code, 0, huffmanCodes);
+// Function to decode 'length' characters from 4 interleaved sub-streams; the four decodes in each
+// iteration do not depend on each other, so the CPU can overlap their table lookups
+static int decodeInterleavedBlock(struct BitReader *readers, const struct DecodeTable *table, unsigned char *output, size_t length) {
+    const struct DecodeEntry *entries = table->entries;
+    int root_bits = table->root_bits;
+    struct BitReader r0 = readers[0], r1 = readers[1], r2 = readers[2], r3 = readers[3];
+    size_t i = 0;
+    for (; i + INTERLEAVED_STREAMS <= length; i += INTERLEAVED_STREAMS) {
+        int c0 = decodeSymbol(&r0, entries, root_bits);
+        int c1 = decodeSymbol(&r1, entries, root_bits);
+        int c2 = decodeSymbol(&r2, entries, root_bits);
+        int c3 = decodeSymbol(&r3, entries, root_bits);
+        if ((c0 | c1 | c2 | c3) < 0) {
+            return -1; // No code matches the input bits
+        }
+        output[i] = (unsigned char)c0;
+        output[i + 1] = (unsigned char)c1;
+        output[i + 2] = (unsigned char)c2;
+        output[i + 3] = (unsigned char)c3;
+    }
+    readers[0] = r0;
+    readers[1] = r1;
+    readers[2] = r2;
+    readers[3] = r3;
+    for (; i < length; i++) {
+        int c = decodeSymbol(&readers[i % INTERLEAVED_STREAMS], entries, root_bits);
+        if (c < 0) {
+            return -1; // No code matches the input bits
+        }
+        output[i] = (unsigned char)c;
+    }
+    return 0;
+}
+#endif
 
-    // Open the output file for writing
-    FILE *output_file = fopen(output_filename, "wb"); // Use binary mode for writing
-    if (output_file == NULL) {
-        perror("Error opening output file");
-        return 1; // Exit with an error code
+// Function to count the bits consumed so far (may pass the end of the data on corrupt input)
+static uint64_t bitsConsumed(const struct BitReader *reader) {
+    return (uint64_t)reader->position * 8 - reader->count;
+}
+
+#ifndef HUFF_NO_MAIN
+// Function to decode a tANS payload of 'length' characters
+static int decodeAnsPayload(const unsigned char *payload, uint32_t payload_bits, const struct AnsDecodeEntry *entries,
+                     unsigned char *output, size_t length) {
+    struct BitReader reader;
+    initBitReader(&reader, payload, ((size_t)payload_bits + 7) / 8);
+    refillBitReader(&reader);
+    uint32_t state = (uint32_t)(reader.bits >> (64 - ANS_TABLE_LOG));
+    reader.bits <<= ANS_TABLE_LOG;
+    reader.count -= ANS_TABLE_LOG;
+    for (size_t i = 0; i < length; i++) {
+        // Every state decodes to a character, corrupt input shows up as a wrong bit count at the end
+        if (reader.count < 32) {
+            refillBitReader(&reader);
+        }
+        const struct AnsDecodeEntry *entry = &entries[state];
+        output[i] = entry->symbol;
+        state = entry->base + (uint32_t)((reader.bits >> 1) >> (63 - entry->bits));
+        reader.bits <<= entry->bits;
+        reader.count -= entry->bits;
     }
+    return bitsConsumed(&reader) == payload_bits ? 0 : -1;
+}
 
-    // Encode the input text using Huffman codes and write to the output file
-    int totalFrequency = 0;
-    int buffer = 0; // Buffer to store bits
-    int buffer_length = 0; // Number of bits in the buffer
-
-    // Encode and write each character from the input file
-    fseek(input_file, 0, SEEK_SET); // Reset the file pointer to the beginning
-    while ((c = fgetc(input_file)) != EOF) {
-        if (c >= 0 && c < MAX_CHARACTERS && huffmanCodes[c].code) {
-            char *char_code = huffmanCodes[c].code;
-            for (int i = 0; char_code[i] != '\0'; i++) {
-                buffer <<= 1; // Shift left
-                if (char_code[i] == '1') {
-                    buffer |= 1; // Set the least significant bit to 1
-                }
-                buffer_length++;
-                if (buffer_length == 8) {
-                    fputc(buffer, output_file);
-                    buffer = 0;
-                    buffer_length = 0;
-                }
-            }
-            totalFrequency += char_frequencies[c].frequency;
+// Function to decode an order-1 payload of 'length' characters, each with the table of the character before it
+static int decodeContextPayload(const unsigned char *payload, uint32_t payload_bits, const struct DecodeTable *const *context_of,
+                         unsigned char *output, size_t length) {
+    // Flat copies of the table pointers keep the lookup of the next table to one load
+    const struct DecodeEntry *entries_of[MAX_CHARACTERS];
+    int root_bits_of[MAX_CHARACTERS];
+    for (int context = 0; context < MAX_CHARACTERS; context++) {
+        entries_of[context] = context_of[context]->entries;
+        root_bits_of[context] = context_of[context]->root_bits;
+    }
+    struct BitReader reader;
+    initBitReader(&reader, payload, ((size_t)payload_bits + 7) / 8);
+    int c = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (entries_of[c] == NULL) {
+            return -1; // The context only uses the fallback table and the file has none
         }
+        c = decodeSymbol(&reader, entries_of[c], root_bits_of[c]);
+        if (c < 0) {
+            return -1; // No code matches the input bits
+        }
+        output[i] = (unsigned char)c;
+    }
+    return bitsConsumed(&reader) == payload_bits ? 0 : -1;
+}
+
+// Function to write a 16-bit value in little endian byte order
+static void writeUint16(FILE *file, uint16_t value) {
+    unsigned char bytes[2] = { (unsigned char)value, (unsigned char)(value >> 8) };
+    fwrite(bytes, 1, 2, file);
+}
+
+// Function to write a 32-bit value in little endian byte order
+static void writeUint32(FILE *file, uint32_t value) {
+    unsigned char bytes[4];
+    for (int i = 0; i < 4; i++) {
+        bytes[i] = (unsigned char)(value >> (8 * i));
+    }
+    fwrite(bytes, 1, 4, file);
+}
+
+// Function to write a 64-bit value in little endian byte order
+static void writeUint64(FILE *file, uint64_t value) {
+    writeUint32(file, (uint32_t)value);
+    writeUint32(file, (uint32_t)(value >> 32));
+}
+
+// Function to read a 16-bit little endian value, returns -1 at end of file
+static int readUint16(FILE *file, uint16_t *value) {
+    unsigned char bytes[2];
+    if (fread(bytes, 1, 2, file) != 2) {
+        return -1;
+    }
+    *value = (uint16_t)(bytes[0] | (bytes[1] << 8));
+    return 0;
+}
+
+// Function to read a 32-bit little endian value, returns -1 at end of file
+static int readUint32(FILE *file, uint32_t *value) {
+    unsigned char bytes[4];
+    if (fread(bytes, 1, 4, file) != 4) {
+        return -1;
     }
+    *value = (uint32_t)bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+    return 0;
+}
 
-    // Write any remaining bits in the buffer to the output file
-    if (buffer_length > 0) {
-        buffer <<= (8 - buffer_length);
-        fputc(buffer, output_file);
+// Function to read a 64-bit little endian value, returns -1 at end of file
+static int readUint64(FILE *file, uint64_t *value) {
+    uint32_t low, high;
+    if (readUint32(file, &low) != 0 || readUint32(file, &high) != 0) {
+        return -1;
     }
+    *value = ((uint64_t)high << 32) | low;
+    return 0;
+}
 
-    // Print Huffman codes for characters
+// Function to print the Huffman code of every character that occurs in the input
+static void printHuffmanCodes(struct HuffmanCode *huffmanCodes, struct CharFrequency *char_frequencies) {
     printf("Huffman Codes:\n");
     printf("%-10s %-20s %-10s\n", "Character", "Code", "Frequencies");
     printf("------------------------------------------------\n");
     for (int i = 0; i < MAX_CHARACTERS; i++) {
         if (huffmanCodes[i].code != NULL) {
             if (huffmanCodes[i].character == '\n') {
-                printf("'\\n'       %-20s %-10d\n", huffmanCodes[i].code, char_frequencies[i].frequency); // Print '\\n' for newline character
+                printf("'\\n'       %-20s %-10llu\n", huffmanCodes[i].code, (unsigned long long)char_frequencies[i].frequency); // Print '\\n' for newline character
             }
             else {
-            printf("'%c'        %-20s %-10d\n", huffmanCodes[i].character, huffmanCodes[i].code, char_frequencies[i].frequency);
+            printf("'%c'        %-20s %-10llu\n", huffmanCodes[i].character, huffmanCodes[i].code,
+                   (unsigned long long)char_frequencies[i].frequency);
             } 
         }
         // Strictly for debugging the extended ascii table's outputs
@@ -293,13 +920,2372 @@ int main(int argc, char *argv[]) {
         //     printf("Character: %c, Code: NULL\n", huffmanCodes[i].character);
         // }
     }
+}
+#endif
 
-    // // Calculate the sum of frequencies at the root node (should be the total frequency)
-    // int totalFrequency = huffmanRoot->frequency;
-    // printf("Total Frequency: %d\n", totalFrequency);
+// Function to compute optimal code lengths of at most 'max_length' bits with the package-merge algorithm
+static int packageMergeLengths(struct CharFrequency *char_frequencies, int max_length, unsigned char *lengths) {
+    // Leaves sorted by frequency, the same list is merged into every level
+    uint64_t leaf_weights[MAX_CHARACTERS];
+    int leaf_characters[MAX_CHARACTERS];
+    int n = 0;
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        lengths[c] = 0;
+        if (char_frequencies[c].frequency > 0) {
+            int i = n++;
+            while (i > 0 && leaf_weights[i - 1] > char_frequencies[c].frequency) {
+                leaf_weights[i] = leaf_weights[i - 1];
+                leaf_characters[i] = leaf_characters[i - 1];
+                i--;
+            }
+            leaf_weights[i] = char_frequencies[c].frequency;
+            leaf_characters[i] = c;
+        }
+    }
+    if (n <= 2) {
+        for (int i = 0; i < n; i++) {
+            lengths[leaf_characters[i]] = 1;
+        }
+        return 0;
+    }
+    if (max_length > MAX_LIMITED_LENGTH || (1 << max_length) < n) {
+        return -1; // n characters need at least log2(n) bits
+    }
 
-    fclose(input_file); // Close the input file
-    fclose(output_file); //Closes the output file
+    // items[l] is the sorted list for code length l + 1: leaves (the character) merged with packages (-1)
+    // of pairs of items from the list of the next longer length
+    static __thread int items[MAX_LIMITED_LENGTH][2 * MAX_CHARACTERS];
+    int item_counts[MAX_LIMITED_LENGTH];
+    uint64_t weights[2][2 * MAX_CHARACTERS];
+    int previous_count = 0;
+    for (int l = max_length - 1; l >= 0; l--) {
+        uint64_t *previous = weights[(l + 1) & 1];
+        uint64_t *current = weights[l & 1];
+        int packages = previous_count / 2;
+        int i = 0, p = 0, count = 0;
+        while (i < n || p < packages) {
+            uint64_t package_weight = p < packages ? previous[2 * p] + previous[2 * p + 1] : 0;
+            if (p >= packages || (i < n && leaf_weights[i] <= package_weight)) {
+                current[count] = leaf_weights[i];
+                items[l][count++] = leaf_characters[i++];
+            } else {
+                current[count] = package_weight;
+                items[l][count++] = -1;
+                p++;
+            }
+        }
+        item_counts[l] = count;
+        previous_count = count;
+    }
+
+    // The first 2n - 2 items of the shortest list are selected; every selected package selects
+    // two more items in the next list, and every selected leaf adds one bit to its character's code
+    int selected = 2 * n - 2;
+    for (int l = 0; l < max_length && selected > 0; l++) {
+        int packages = 0;
+        for (int i = 0; i < selected && i < item_counts[l]; i++) {
+            if (items[l][i] < 0) {
+                packages++;
+            } else {
+                lengths[items[l][i]]++;
+            }
+        }
+        selected = 2 * packages;
+    }
+    return 0;
+}
+
+#ifndef HUFF_NO_MAIN
+// Function to print the normalized tANS count of every character next to its frequency
+static void printAnsCounts(const uint16_t *counts, const struct CharFrequency *char_frequencies) {
+    printf("tANS Counts (of %d states):\n", ANS_TABLE_SIZE);
+    printf("%-10s %-20s %-10s\n", "Character", "Count", "Frequencies");
+    printf("------------------------------------------------\n");
+    for (int i = 0; i < MAX_CHARACTERS; i++) {
+        if (counts[i] == 0) {
+            continue;
+        }
+        if (i == '\n') {
+            printf("'\\n'       %-20d %-10llu\n", counts[i], (unsigned long long)char_frequencies[i].frequency);
+        } else {
+            printf("'%c'        %-20d %-10llu\n", i, counts[i], (unsigned long long)char_frequencies[i].frequency);
+        }
+    }
+}
+#endif
+
+// Library API, declared in huff.h (build with -DHUFF_NO_MAIN to link this file into another program; main and
+// the code only it uses are left out by the #ifndef HUFF_NO_MAIN blocks)
+
+// Function to make the canonical codes and the decode tables of a context from its code lengths,
+// returns -1 if the lengths do not form a prefix code or are longer than HUFF_MAX_LENGTH
+int huff_use_lengths(struct huff_ctx *ctx, const unsigned char *lengths) {
+    if (lengths != ctx->lengths) {
+        memcpy(ctx->lengths, lengths, MAX_CHARACTERS);
+    }
+    memset(ctx->length_counts, 0, sizeof(ctx->length_counts));
+    ctx->max_length = 0;
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        if (lengths[c] > HUFF_MAX_LENGTH) {
+            return -1;
+        }
+        ctx->length_counts[lengths[c]]++;
+        if (lengths[c] > ctx->max_length) {
+            ctx->max_length = lengths[c];
+        }
+    }
+    if (buildCanonicalCodes(lengths, ctx->codes) != 0) {
+        return -1;
+    }
 
-    return 0; // Exit successfully
+    // Characters in canonical order (by length, ties by character) and where each length starts
+    int offset = 0;
+    for (int length = 1; length <= HUFF_MAX_LENGTH; length++) {
+        ctx->offsets[length] = (uint16_t)offset;
+        offset += ctx->length_counts[length];
+    }
+    uint16_t next[HUFF_MAX_LENGTH + 1];
+    memcpy(next, ctx->offsets, sizeof(next));
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        if (lengths[c] > 0) {
+            ctx->sorted[next[lengths[c]]++] = (uint8_t)c;
+            if (ctx->offsets[lengths[c]] + 1 == next[lengths[c]]) {
+                ctx->first[lengths[c]] = ctx->codes[c].bits;
+            }
+        }
+    }
+
+    // Codes up to HUFF_FAST_BITS long fill every slot they are a prefix of
+    memset(ctx->fast, 0, sizeof(ctx->fast));
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        int length = lengths[c];
+        if (length > 0 && length <= HUFF_FAST_BITS) {
+            uint64_t start = ctx->codes[c].bits << (HUFF_FAST_BITS - length);
+            for (uint64_t slot = start; slot < start + (1u << (HUFF_FAST_BITS - length)); slot++) {
+                ctx->fast[slot] = (uint16_t)(length << 8 | c);
+            }
+        }
+    }
+    return 0;
+}
+
+// Function to build the codes of a histogram in the context's arena: the leaves sorted by weight form one
+// queue and the internal nodes, made in ascending weight order, a second one, so the tree takes O(n)
+// after the sort; with 'max_length' > 0 the lengths come from package-merge instead. Returns -1 if
+// 'max_length' is too short for the number of characters
+int huff_build(struct huff_ctx *ctx, const uint64_t *counts, int max_length) {
+    unsigned char lengths[MAX_CHARACTERS];
+    if (max_length > 0) {
+        struct CharFrequency char_frequencies[MAX_CHARACTERS];
+        for (int c = 0; c < MAX_CHARACTERS; c++) {
+            char_frequencies[c].character = (char)c;
+            char_frequencies[c].frequency = counts[c];
+        }
+        if (packageMergeLengths(char_frequencies, max_length, lengths) != 0) {
+            return -1;
+        }
+        return huff_use_lengths(ctx, lengths);
+    }
+
+    // Leaves in ascending weight order (insertion sort keeps ties in character order)
+    uint64_t *weights = ctx->weights;
+    int n = 0;
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        if (counts[c] > 0) {
+            int i = n++;
+            while (i > 0 && weights[i - 1] > counts[c]) {
+                weights[i] = weights[i - 1];
+                ctx->leaves[i] = ctx->leaves[i - 1];
+                i--;
+            }
+            weights[i] = counts[c];
+            ctx->leaves[i] = (uint8_t)c;
+        }
+    }
+
+    // Each internal node joins the two lightest nodes at the heads of the queues, leaves first on ties
+    int16_t *parents = ctx->parents;
+    int leaf = 0, internal = n;
+    for (int node = n; node < 2 * n - 1; node++) {
+        weights[node] = 0;
+        for (int pick = 0; pick < 2; pick++) {
+            int child = leaf < n && (internal >= node || weights[leaf] <= weights[internal]) ? leaf++ : internal++;
+            weights[node] += weights[child];
+            parents[child] = (int16_t)node;
+        }
+    }
+
+    // Parents always come after their children, so one pass from the root turns parents into depths
+    memset(lengths, 0, sizeof(lengths));
+    if (n == 1) {
+        lengths[ctx->leaves[0]] = 1; // A single character still needs a one bit code to be decodable
+    } else if (n > 1) {
+        parents[2 * n - 2] = 0;
+        for (int node = 2 * n - 3; node >= 0; node--) {
+            parents[node] = (int16_t)(parents[parents[node]] + 1);
+        }
+        for (int i = 0; i < n; i++) {
+            if (parents[i] > HUFF_MAX_LENGTH) {
+                return huff_build(ctx, counts, MAX_LIMITED_LENGTH); // Only for 2^32 characters or more
+            }
+            lengths[ctx->leaves[i]] = (unsigned char)parents[i];
+        }
+    }
+    return huff_use_lengths(ctx, lengths);
+}
+
+// Function to encode a record with the codes of a context into 'output', returns the bytes written,
+// or 0 if the record has a character without a code or does not fit in 'capacity' bytes
+size_t huff_encode(const struct huff_ctx *ctx, const unsigned char *data, size_t size, unsigned char *output, size_t capacity) {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (ctx->lengths[data[i]] == 0) {
+            return 0;
+        }
+        bits += ctx->lengths[data[i]];
+    }
+    if ((bits + 7) / 8 > capacity) {
+        return 0;
+    }
+    // A writer over the caller's buffer never needs to grow, it was sized by the pass above
+    struct BitWriter writer = { 0, 0, output, 0, capacity, NULL };
+    encodeBlock(&writer, ctx->codes, data, size);
+    alignBitWriter(&writer);
+    return writer.position;
+}
+
+// Function to decode a record of 'size' characters coded with the codes of a context, returns -1 if
+// the input is not a valid record
+int huff_decode(const struct huff_ctx *ctx, const unsigned char *input, size_t input_size, unsigned char *output, size_t size) {
+    struct BitReader reader;
+    initBitReader(&reader, input, input_size);
+    for (size_t i = 0; i < size; i++) {
+        if (reader.count < HUFF_MAX_LENGTH) {
+            refillBitReader(&reader);
+        }
+        uint16_t entry = ctx->fast[reader.bits >> (64 - HUFF_FAST_BITS)];
+        int length = entry >> 8;
+        if (length > 0) {
+            output[i] = (unsigned char)entry;
+        } else {
+            // Longer codes: the code of each length is compared with the range of its canonical codes
+            for (length = HUFF_FAST_BITS + 1; length <= ctx->max_length; length++) {
+                uint64_t code = reader.bits >> (64 - length);
+                if (code - ctx->first[length] < ctx->length_counts[length]) {
+                    output[i] = ctx->sorted[ctx->offsets[length] + (code - ctx->first[length])];
+                    break;
+                }
+            }
+            if (length > ctx->max_length) {
+                return -1;
+            }
+        }
+        reader.bits <<= length;
+        reader.count -= length;
+    }
+    return bitsConsumed(&reader) <= (uint64_t)input_size * 8 ? 0 : -1;
+}
+
+// Function to compress a record with its own codes: u32 size, u16 n and n code lengths as in the container
+// header, then the payload; returns the bytes written, or 0 if they do not fit in 'capacity' bytes
+size_t huff_compress(struct huff_ctx *ctx, const unsigned char *data, size_t size, unsigned char *output, size_t capacity) {
+    uint64_t counts[MAX_CHARACTERS] = { 0 };
+    int n = 0;
+    if (size > UINT32_MAX) {
+        return 0;
+    }
+    for (size_t i = 0; i < size; i++) {
+        counts[data[i]]++;
+    }
+    huff_build(ctx, counts, 0);
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        if (ctx->lengths[c] > 0) {
+            n = c + 1;
+        }
+    }
+    size_t header = 6 + (size_t)n;
+    if (capacity < header) {
+        return 0;
+    }
+    for (int b = 0; b < 4; b++) {
+        output[b] = (unsigned char)(size >> (8 * b));
+    }
+    output[4] = (unsigned char)n;
+    output[5] = (unsigned char)(n >> 8);
+    memcpy(output + 6, ctx->lengths, (size_t)n);
+    if (size == 0) {
+        return header;
+    }
+    size_t payload = huff_encode(ctx, data, size, output + header, capacity - header);
+    return payload > 0 ? header + payload : 0;
+}
+
+// Function to decompress a record made by huff_compress, returns its size, or -1 if the input is not
+// a valid record or the record does not fit in 'capacity' bytes
+int64_t huff_decompress(struct huff_ctx *ctx, const unsigned char *input, size_t input_size, unsigned char *output, size_t capacity) {
+    if (input_size < 6) {
+        return -1;
+    }
+    uint32_t size = (uint32_t)input[0] | ((uint32_t)input[1] << 8) | ((uint32_t)input[2] << 16) | ((uint32_t)input[3] << 24);
+    int n = input[4] | (input[5] << 8);
+    unsigned char lengths[MAX_CHARACTERS] = { 0 };
+    if (n > MAX_CHARACTERS || input_size < 6 + (size_t)n || size > capacity) {
+        return -1;
+    }
+    memcpy(lengths, input + 6, (size_t)n);
+    if (huff_use_lengths(ctx, lengths) != 0 ||
+        huff_decode(ctx, input + 6 + n, input_size - 6 - (size_t)n, output, size) != 0) {
+        return -1;
+    }
+    return size;
+}
+
+#ifndef HUFF_NO_MAIN
+// Function to build length limited codes: package-merge lengths, then their canonical codes
+static int buildLimitedCodes(struct CharFrequency *char_frequencies, int max_length, struct HuffmanCode *huffmanCodes, struct BitCode *bitCodes) {
+    unsigned char lengths[MAX_CHARACTERS];
+    if (packageMergeLengths(char_frequencies, max_length, lengths) != 0) {
+        return -1;
+    }
+    endPhase(PHASE_TREE);
+    buildCanonicalCodes(lengths, bitCodes);
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        huffmanCodes[c].character = c;
+        huffmanCodes[c].code = NULL;
+        if (lengths[c] > 0) {
+            huffmanCodes[c].code = (char *)malloc(lengths[c] + 1);
+            for (int j = 0; j < lengths[c]; j++) {
+                huffmanCodes[c].code[j] = (bitCodes[c].bits >> (lengths[c] - 1 - j)) & 1 ? '1' : '0';
+            }
+            huffmanCodes[c].code[lengths[c]] = '\0';
+        }
+    }
+    endPhase(PHASE_CODES);
+    return 0;
+}
+
+// Function to build the codes for a frequency table, returns -1 if no character occurs
+static int buildCodes(struct CharFrequency *char_frequencies, int max_length, struct HuffmanCode *huffmanCodes, struct BitCode *bitCodes) {
+    for (int i = 0; i < MAX_CHARACTERS; i++) {
+        huffmanCodes[i].character = i;
+        huffmanCodes[i].code = NULL;
+    }
+
+    int distinct = 0;
+    for (int i = 0; i < MAX_CHARACTERS; i++) {
+        if (char_frequencies[i].frequency > 0) {
+            distinct++;
+        }
+    }
+    if (distinct == 0) {
+        buildBitCodes(huffmanCodes, bitCodes);
+        return -1;
+    }
+    if (max_length > 0) {
+        return buildLimitedCodes(char_frequencies, max_length, huffmanCodes, bitCodes);
+    }
+
+    // Build the Huffman tree
+    struct Node *huffmanRoot = buildHuffmanTree(char_frequencies);
+    endPhase(PHASE_TREE);
+
+    // Assign Huffman codes to characters (a skewed tree can be MAX_CHARACTERS - 1 levels deep)
+    char code[MAX_CHARACTERS + 1];
+    code[0] = '\0';
+    assignHuffmanCodes(huffmanRoot, code, 0, huffmanCodes);
+    freeHuffmanTree(huffmanRoot);
+
+    // Convert the codes into (bits, length) pairs for the table-driven encoder and decoder
+    buildBitCodes(huffmanCodes, bitCodes);
+    endPhase(PHASE_CODES);
+    return 0;
+}
+
+// Function to make sure a buffer holds at least 'size' bytes
+static int reserveBuffer(unsigned char **buffer, size_t *capacity, size_t size) {
+    if (size > *capacity) {
+        unsigned char *grown = (unsigned char *)realloc(*buffer, size);
+        if (grown == NULL) {
+            return -1;
+        }
+        *buffer = grown;
+        *capacity = size;
+    }
+    return 0;
+}
+
+// Function to load an input file ("-" is standard input) so it can be read twice without seeking
+static int openInput(const char *filename, struct InputData *input) {
+    int fd = strcmp(filename, "-") == 0 ? STDIN_FILENO : open(filename, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    input->data = NULL;
+    input->size = 0;
+    input->mapped = 0;
+
+    // Regular files are mapped with sequential read-ahead, the page cache is the only copy
+    struct stat info;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+            input->data = (const unsigned char *)data;
+            input->size = (size_t)info.st_size;
+            input->mapped = 1;
+            if (fd != STDIN_FILENO) {
+                close(fd);
+            }
+            return 0;
+        }
+    }
+
+    // Pipes and other unmappable inputs are read in large chunks into a growing buffer
+    size_t capacity = IO_BUFFER_SIZE;
+    unsigned char *buffer = (unsigned char *)malloc(capacity);
+    ssize_t bytes_read;
+    while (buffer != NULL && (bytes_read = read(fd, buffer + input->size, capacity - input->size)) != 0) {
+        if (bytes_read < 0) {
+            free(buffer);
+            buffer = NULL;
+            break;
+        }
+        input->size += (size_t)bytes_read;
+        if (input->size == capacity && reserveBuffer(&buffer, &capacity, capacity * 2) != 0) {
+            free(buffer);
+            buffer = NULL;
+        }
+    }
+    if (fd != STDIN_FILENO) {
+        close(fd);
+    }
+    input->data = buffer;
+    return buffer != NULL ? 0 : -1;
+}
+
+// Function to release an input loaded by openInput
+static void closeInput(struct InputData *input) {
+    if (input->mapped) {
+        munmap((void *)input->data, input->size);
+    } else {
+        free((void *)input->data);
+    }
+    input->data = NULL;
+}
+
+// Function to count character frequencies, spread over four tables so repeated characters do not stall
+static void countFrequencies(const unsigned char *data, size_t size, struct CharFrequency *char_frequencies) {
+    uint64_t counts[4][MAX_CHARACTERS];
+    memset(counts, 0, sizeof(counts));
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        counts[0][data[i]]++;
+        counts[1][data[i + 1]]++;
+        counts[2][data[i + 2]]++;
+        counts[3][data[i + 3]]++;
+    }
+    for (; i < size; i++) {
+        counts[0][data[i]]++;
+    }
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        char_frequencies[c].frequency += counts[0][c] + counts[1][c] + counts[2][c] + counts[3][c];
+    }
+}
+
+// Function to run 'count' jobs, each on its own thread (a single job runs on the calling thread)
+static int runJobs(void *(*function)(void *), void *jobs, size_t job_size, int count) {
+    if (count == 1) {
+        function(jobs);
+        return 0;
+    }
+    pthread_t threads[MAX_THREADS];
+    int started = 0;
+    for (; started < count; started++) {
+        if (pthread_create(&threads[started], NULL, function, (char *)jobs + started * job_size) != 0) {
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    // Jobs that did not get a thread run here
+    for (int i = started; i < count; i++) {
+        function((char *)jobs + i * job_size);
+    }
+    return 0;
+}
+
+// Thread function to count the characters of one slice of the input
+static void *histogramWorker(void *argument) {
+    struct HistogramJob *job = (struct HistogramJob *)argument;
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        job->frequencies[c].character = c;
+        job->frequencies[c].frequency = 0;
+    }
+    countFrequencies(job->data, job->size, job->frequencies);
+    return NULL;
+}
+
+// Function to count character frequencies with one partial histogram per thread, then merge them
+static void countFrequenciesParallel(const unsigned char *data, size_t size, int threads, struct CharFrequency *char_frequencies) {
+    if (threads <= 1 || size < (size_t)threads * IO_BUFFER_SIZE) {
+        countFrequencies(data, size, char_frequencies);
+        return;
+    }
+    struct HistogramJob *jobs = (struct HistogramJob *)malloc(threads * sizeof(struct HistogramJob));
+    if (jobs == NULL) {
+        countFrequencies(data, size, char_frequencies);
+        return;
+    }
+    size_t slice = size / threads;
+    for (int t = 0; t < threads; t++) {
+        jobs[t].data = data + t * slice;
+        jobs[t].size = t == threads - 1 ? size - t * slice : slice;
+    }
+    runJobs(histogramWorker, jobs, sizeof(struct HistogramJob), threads);
+    for (int t = 0; t < threads; t++) {
+        for (int c = 0; c < MAX_CHARACTERS; c++) {
+            char_frequencies[c].frequency += jobs[t].frequencies[c].frequency;
+        }
+    }
+    free(jobs);
+}
+
+// Function to set up the writers of an encode job, returns -1 when out of memory
+static int initEncodeJob(struct EncodeJob *job, int interleave) {
+    job->interleave = interleave;
+    job->ans = NULL;
+    job->context_codes = NULL;
+    job->ans_codes = NULL;
+    job->ans_capacity = 0;
+    if (initBitWriter(&job->writer, NULL) != 0) {
+        return -1;
+    }
+    for (int k = 0; interleave && k < INTERLEAVED_STREAMS; k++) {
+        if (initBitWriter(&job->streams[k], NULL) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to release the writers of an encode job
+static void freeEncodeJob(struct EncodeJob *job) {
+    free(job->writer.buffer);
+    free(job->ans_codes);
+    for (int k = 0; job->interleave && k < INTERLEAVED_STREAMS; k++) {
+        free(job->streams[k].buffer);
+    }
+}
+
+// Function to encode a block as 4 sub-streams behind a jump table of their bit counts
+static uint32_t encodeInterleavedBlock(struct EncodeJob *job) {
+    struct BitWriter *streams = job->streams;
+    const struct BitCode *bitCodes = job->bitCodes;
+    const unsigned char *data = job->data;
+    for (int k = 0; k < INTERLEAVED_STREAMS; k++) {
+        resetBitWriter(&streams[k]);
+    }
+    size_t i = 0;
+    for (; i + INTERLEAVED_STREAMS <= job->size; i += INTERLEAVED_STREAMS) {
+        writeBits(&streams[0], bitCodes[data[i]].bits, bitCodes[data[i]].length);
+        writeBits(&streams[1], bitCodes[data[i + 1]].bits, bitCodes[data[i + 1]].length);
+        writeBits(&streams[2], bitCodes[data[i + 2]].bits, bitCodes[data[i + 2]].length);
+        writeBits(&streams[3], bitCodes[data[i + 3]].bits, bitCodes[data[i + 3]].length);
+    }
+    for (; i < job->size; i++) {
+        writeBits(&streams[i % INTERLEAVED_STREAMS], bitCodes[data[i]].bits, bitCodes[data[i]].length);
+    }
+
+    // Jump table, then the byte aligned sub-streams back to back
+    uint32_t stream_bits[INTERLEAVED_STREAMS];
+    size_t total = 4 * INTERLEAVED_STREAMS;
+    for (int k = 0; k < INTERLEAVED_STREAMS; k++) {
+        stream_bits[k] = (uint32_t)(streams[k].position * 8 + streams[k].count);
+        alignBitWriter(&streams[k]);
+        total += streams[k].position;
+    }
+    if (reserveBuffer(&job->writer.buffer, &job->writer.capacity, total) != 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        exit(1);
+    }
+    unsigned char *out = job->writer.buffer;
+    for (int k = 0; k < INTERLEAVED_STREAMS; k++) {
+        for (int b = 0; b < 4; b++) {
+            *out++ = (unsigned char)(stream_bits[k] >> (8 * b));
+        }
+    }
+    for (int k = 0; k < INTERLEAVED_STREAMS; k++) {
+        memcpy(out, streams[k].buffer, streams[k].position);
+        out += streams[k].position;
+    }
+    job->writer.position = total;
+    return (uint32_t)((total - streams[INTERLEAVED_STREAMS - 1].position) * 8 + stream_bits[INTERLEAVED_STREAMS - 1]);
+}
+
+// Function to scale a histogram to counts adding up to ANS_TABLE_SIZE, every present character keeps at least 1
+static void normalizeAnsCounts(const struct CharFrequency *char_frequencies, uint16_t *counts) {
+    uint64_t total = 0;
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        total += char_frequencies[c].frequency;
+    }
+    int sum = 0;
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        counts[c] = 0;
+        if (char_frequencies[c].frequency > 0) {
+            uint64_t scaled = (char_frequencies[c].frequency * ANS_TABLE_SIZE + total / 2) / total;
+            counts[c] = (uint16_t)(scaled > 0 ? scaled : 1);
+            sum += counts[c];
+        }
+    }
+    if (total == 0) {
+        return;
+    }
+
+    // Rounding leaves the sum a little off, the largest counts absorb the difference at the least cost
+    while (sum != ANS_TABLE_SIZE) {
+        int largest = 0;
+        for (int c = 1; c < MAX_CHARACTERS; c++) {
+            if (counts[c] > counts[largest]) {
+                largest = c;
+            }
+        }
+        if (sum < ANS_TABLE_SIZE) {
+            counts[largest] += (uint16_t)(ANS_TABLE_SIZE - sum);
+            sum = ANS_TABLE_SIZE;
+        } else {
+            counts[largest]--;
+            sum--;
+        }
+    }
+}
+
+// Function to spread the characters over the states, each gets as many states as its count (-1 if the counts are invalid)
+static int spreadAnsSymbols(const uint16_t *counts, unsigned char *symbols) {
+    int sum = 0;
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        sum += counts[c];
+    }
+    if (sum != ANS_TABLE_SIZE) {
+        return -1;
+    }
+    // An odd step visits every state once, and scatters the states of a character over the table
+    const int step = (ANS_TABLE_SIZE >> 1) + (ANS_TABLE_SIZE >> 3) + 3;
+    int position = 0;
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        for (int j = 0; j < counts[c]; j++) {
+            symbols[position] = (unsigned char)c;
+            position = (position + step) & (ANS_TABLE_SIZE - 1);
+        }
+    }
+    return 0;
+}
+
+// Function to return floor(log2(value)) of a value above 0
+static inline int highestBit(uint32_t value) {
+    return 31 - __builtin_clz(value);
+}
+
+// Function to build the tANS encoder of a set of normalized counts
+static int buildAnsEncoder(const uint16_t *counts, struct AnsEncoder *encoder) {
+    unsigned char symbols[ANS_TABLE_SIZE];
+    if (spreadAnsSymbols(counts, symbols) != 0) {
+        return -1;
+    }
+    int next[MAX_CHARACTERS];
+    int start = 0;
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        encoder->counts[c] = counts[c];
+        encoder->start[c] = start;
+        encoder->shift[c] = (uint8_t)(counts[c] > 0 ? ANS_TABLE_LOG - highestBit(counts[c]) : 0);
+        next[c] = start;
+        start += counts[c];
+    }
+    for (int x = 0; x < ANS_TABLE_SIZE; x++) {
+        encoder->states[next[symbols[x]]++] = (uint16_t)(ANS_TABLE_SIZE + x);
+    }
+    return 0;
+}
+
+// Function to build the tANS decode table of a set of normalized counts
+static int buildAnsDecodeTable(const uint16_t *counts, struct AnsDecodeEntry *entries) {
+    unsigned char symbols[ANS_TABLE_SIZE];
+    if (spreadAnsSymbols(counts, symbols) != 0) {
+        return -1;
+    }
+    uint32_t next[MAX_CHARACTERS];
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        next[c] = counts[c];
+    }
+    for (int x = 0; x < ANS_TABLE_SIZE; x++) {
+        // The k-th state of a character maps back to count + k, scaled up to [ANS_TABLE_SIZE, 2 * ANS_TABLE_SIZE)
+        uint32_t state = next[symbols[x]]++;
+        int bits = ANS_TABLE_LOG - highestBit(state);
+        entries[x].symbol = symbols[x];
+        entries[x].bits = (uint8_t)bits;
+        entries[x].base = (uint16_t)((state << bits) - ANS_TABLE_SIZE);
+    }
+    return 0;
+}
+
+// Function to encode a block with tANS; the characters are coded last to first, so their bits are
+// collected and written afterwards in input order behind the final state, where the decoder starts
+static uint32_t encodeAnsBlock(struct EncodeJob *job) {
+    const struct AnsEncoder *encoder = job->ans;
+    const unsigned char *data = job->data;
+    if (job->size > job->ans_capacity) {
+        uint32_t *codes = (uint32_t *)realloc(job->ans_codes, job->size * sizeof(uint32_t));
+        if (codes == NULL) {
+            fprintf(stderr, "Error: Out of memory\n");
+            exit(1);
+        }
+        job->ans_codes = codes;
+        job->ans_capacity = job->size;
+    }
+    uint32_t *codes = job->ans_codes;
+
+    uint32_t state = ANS_TABLE_SIZE;
+    for (size_t i = job->size; i-- > 0;) {
+        int c = data[i];
+        uint32_t count = encoder->counts[c];
+        int bits = encoder->shift[c];
+        if ((state >> bits) < count) {
+            bits--;
+        }
+        codes[i] = (state & ((1u << bits) - 1)) | ((uint32_t)bits << 16);
+        state = encoder->states[encoder->start[c] + (state >> bits) - count];
+    }
+
+    resetBitWriter(&job->writer);
+    putBits(&job->writer, state - ANS_TABLE_SIZE, ANS_TABLE_LOG);
+    for (size_t i = 0; i < job->size; i++) {
+        putBits(&job->writer, codes[i] & 0xFFFF, (int)(codes[i] >> 16));
+    }
+    uint32_t payload_bits = (uint32_t)(job->writer.position * 8 + job->writer.count);
+    alignBitWriter(&job->writer);
+    return payload_bits;
+}
+
+// Function to encode a block with the table of each character's previous character
+static void encodeContextBlock(struct BitWriter *writer, const struct BitCode *const *context_codes, const unsigned char *data, size_t length) {
+    const struct BitCode *codes = context_codes[0];
+    for (size_t i = 0; i < length; i++) {
+        const struct BitCode *code = &codes[data[i]];
+        writeBits(writer, code->bits, code->length);
+        codes = context_codes[data[i]];
+    }
+}
+
+// Thread function to encode one container block into the job's own bit buffer
+static void *encodeWorker(void *argument) {
+    struct EncodeJob *job = (struct EncodeJob *)argument;
+    if (job->ans != NULL) {
+        job->payload_bits = encodeAnsBlock(job);
+        return NULL;
+    }
+    if (job->context_codes != NULL) {
+        resetBitWriter(&job->writer);
+        encodeContextBlock(&job->writer, job->context_codes, job->data, job->size);
+        job->payload_bits = (uint32_t)(job->writer.position * 8 + job->writer.count);
+        alignBitWriter(&job->writer);
+        return NULL;
+    }
+    if (job->interleave) {
+        job->payload_bits = encodeInterleavedBlock(job);
+        return NULL;
+    }
+    resetBitWriter(&job->writer);
+    encodeBlock(&job->writer, job->bitCodes, job->data, job->size);
+    // Each container block is byte aligned and records its exact bit count
+    job->payload_bits = (uint32_t)(job->writer.position * 8 + job->writer.count);
+    alignBitWriter(&job->writer);
+    return NULL;
+}
+
+// Function to replace the tree codes with their canonical codes (printed and used by the container)
+static void useCanonicalCodes(struct HuffmanCode *huffmanCodes, struct BitCode *bitCodes, unsigned char *lengths) {
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        lengths[c] = (unsigned char)bitCodes[c].length;
+    }
+    buildCanonicalCodes(lengths, bitCodes);
+
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        if (huffmanCodes[c].code == NULL) {
+            continue;
+        }
+        for (int j = 0; j < bitCodes[c].length; j++) {
+            huffmanCodes[c].code[j] = (bitCodes[c].bits >> (bitCodes[c].length - 1 - j)) & 1 ? '1' : '0';
+        }
+    }
+    endPhase(PHASE_CODES);
+}
+
+// Function to count each character by the character before it, the context restarts at every block
+static void countContextFrequencies(const unsigned char *data, size_t size, size_t block_size, uint64_t (*frequencies)[MAX_CHARACTERS]) {
+    for (size_t offset = 0; offset < size; offset += block_size) {
+        size_t end = size - offset < block_size ? size : offset + block_size;
+        int previous = 0;
+        for (size_t i = offset; i < end; i++) {
+            frequencies[previous][data[i]]++;
+            previous = data[i];
+        }
+    }
+}
+
+// Function to build canonical codes for one histogram row, returns the bits it takes to code the row
+static uint64_t buildContextTable(const uint64_t *counts, int max_length, unsigned char *lengths, struct BitCode *bitCodes) {
+    struct huff_ctx huff;
+    huff_build(&huff, counts, max_length);
+    memcpy(lengths, huff.lengths, MAX_CHARACTERS);
+    memcpy(bitCodes, huff.codes, sizeof(huff.codes));
+    uint64_t bits = 0;
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        bits += counts[c] * bitCodes[c].length;
+    }
+    return bits;
+}
+
+// Function to build the order-1 tables of an input from its 256x256 histogram; a context keeps its own
+// table only if that saves more bits than the table costs in the header, the others share the fallback
+static struct ContextCodes *buildContextCodes(const unsigned char *data, size_t size, const struct CompressOptions *options,
+                                       const struct BitCode *order0_codes) {
+    struct ContextCodes *contexts = (struct ContextCodes *)calloc(1, sizeof(struct ContextCodes));
+    uint64_t (*frequencies)[MAX_CHARACTERS] = (uint64_t (*)[MAX_CHARACTERS])calloc(MAX_CHARACTERS, sizeof(*frequencies));
+    if (contexts == NULL || frequencies == NULL) {
+        free(contexts);
+        free(frequencies);
+        return NULL;
+    }
+    int max_length = options->max_length > 0 ? options->max_length : CONTEXT_MAX_LENGTH;
+    countContextFrequencies(data, size, options->block_size, frequencies);
+    endPhase(PHASE_HISTOGRAM);
+
+    uint64_t fallback[MAX_CHARACTERS] = { 0 };
+    for (int context = 0; context < MAX_CHARACTERS; context++) {
+        uint64_t order0_bits = 0;
+        int present = 0;
+        for (int c = 0; c < MAX_CHARACTERS; c++) {
+            order0_bits += frequencies[context][c] * order0_codes[c].length;
+            present = frequencies[context][c] > 0 ? c + 1 : present;
+        }
+        contexts->order0_bits += order0_bits;
+        uint64_t own_bits = present > 0 ? buildContextTable(frequencies[context], max_length, contexts->lengths[context],
+                                                            contexts->bitCodes[context]) : 0;
+        uint64_t table_bits = 8 * (2 + (uint64_t)present);
+        if (present > 0 && own_bits + table_bits < order0_bits) {
+            contexts->own[context] = 1;
+            contexts->codes_of[context] = contexts->bitCodes[context];
+            contexts->order1_bits += own_bits;
+            contexts->tables++;
+        } else {
+            memset(contexts->lengths[context], 0, MAX_CHARACTERS);
+            contexts->codes_of[context] = contexts->bitCodes[MAX_CHARACTERS];
+            for (int c = 0; c < MAX_CHARACTERS; c++) {
+                fallback[c] += frequencies[context][c];
+            }
+        }
+    }
+    contexts->order1_bits += buildContextTable(fallback, max_length, contexts->lengths[MAX_CHARACTERS],
+                                               contexts->bitCodes[MAX_CHARACTERS]);
+    free(frequencies);
+    return contexts;
+}
+
+// Function to print how the order-1 tables compare with the order-0 codes
+static void printContextSummary(const struct ContextCodes *contexts, uint64_t original_size, uint64_t file_size, double encode_seconds) {
+    uint64_t order0_bytes = (contexts->order0_bits + 7) / 8;
+    uint64_t order1_bytes = (contexts->order1_bits + 7) / 8;
+    printf("Order-1 Huffman Codes:\n");
+    printf("Contexts with their own table: %d, others share the fallback table\n", contexts->tables);
+    printf("%-10s %-20s %-10s\n", "Model", "Payload bytes", "Ratio");
+    printf("------------------------------------------------\n");
+    printf("%-10s %-20llu %-10.4f\n", "order-0", (unsigned long long)order0_bytes,
+           original_size ? (double)order0_bytes / original_size : 0.0);
+    printf("%-10s %-20llu %-10.4f\n", "order-1", (unsigned long long)order1_bytes,
+           original_size ? (double)order1_bytes / original_size : 0.0);
+    printf("Output file: %llu bytes (ratio %.4f), encoded at %.1f MB/s\n", (unsigned long long)file_size,
+           original_size ? (double)file_size / original_size : 0.0,
+           encode_seconds > 0 ? original_size / encode_seconds / 1e6 : 0.0);
+}
+
+// Function to write a code length table, trailing absent characters are left out; returns its size
+static int writeCodeLengths(FILE *output_file, const unsigned char *lengths) {
+    int count = MAX_CHARACTERS;
+    while (count > 0 && (lengths == NULL || lengths[count - 1] == 0)) {
+        count--;
+    }
+    writeUint16(output_file, (uint16_t)count);
+    if (count > 0) {
+        fwrite(lengths, 1, count, output_file);
+    }
+    return 2 + count;
+}
+
+// Function to read a code length table written by writeCodeLengths
+static int readCodeLengths(FILE *input_file, unsigned char *lengths) {
+    uint16_t count;
+    memset(lengths, 0, MAX_CHARACTERS);
+    if (readUint16(input_file, &count) != 0 || count > MAX_CHARACTERS || fread(lengths, 1, count, input_file) != count) {
+        return -1;
+    }
+    return 0;
+}
+
+// Function to write a table of normalized tANS counts, trailing absent characters are left out; returns its size
+static int writeAnsCounts(FILE *output_file, const uint16_t *counts) {
+    int count = MAX_CHARACTERS;
+    while (count > 0 && (counts == NULL || counts[count - 1] == 0)) {
+        count--;
+    }
+    writeUint16(output_file, (uint16_t)count);
+    for (int c = 0; c < count; c++) {
+        writeUint16(output_file, counts[c]);
+    }
+    return 2 + 2 * count;
+}
+
+// Function to read a table of normalized tANS counts written by writeAnsCounts
+static int readAnsCounts(FILE *input_file, uint16_t *counts) {
+    uint16_t count;
+    memset(counts, 0, MAX_CHARACTERS * sizeof(uint16_t));
+    if (readUint16(input_file, &count) != 0 || count > MAX_CHARACTERS) {
+        return -1;
+    }
+    for (int c = 0; c < count; c++) {
+        if (readUint16(input_file, &counts[c]) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to write the order-1 context bitmap and the code lengths of every context that has its own table
+static uint64_t writeContextTables(FILE *output_file, const struct ContextCodes *contexts) {
+    unsigned char bitmap[MAX_CHARACTERS / 8] = { 0 };
+    for (int context = 0; context < MAX_CHARACTERS; context++) {
+        bitmap[context >> 3] |= (unsigned char)(contexts->own[context] << (context & 7));
+    }
+    fwrite(bitmap, 1, sizeof(bitmap), output_file);
+    uint64_t size = sizeof(bitmap);
+    for (int context = 0; context < MAX_CHARACTERS; context++) {
+        if (contexts->own[context]) {
+            size += writeCodeLengths(output_file, contexts->lengths[context]);
+        }
+    }
+    return size;
+}
+
+// Function to read the order-1 tables after the fallback code lengths and build their decode tables
+static int readContextTables(FILE *input_file, struct Decoder *decoder, const unsigned char *fallback_lengths) {
+    unsigned char bitmap[MAX_CHARACTERS / 8];
+    unsigned char lengths[MAX_CHARACTERS];
+    struct BitCode bitCodes[MAX_CHARACTERS];
+    decoder->context_tables = (struct DecodeTable *)calloc(MAX_CHARACTERS + 1, sizeof(struct DecodeTable));
+    if (decoder->context_tables == NULL || fread(bitmap, 1, sizeof(bitmap), input_file) != sizeof(bitmap)) {
+        return -1;
+    }
+    struct DecodeTable *fallback = &decoder->context_tables[MAX_CHARACTERS];
+    int has_fallback = 0;
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        has_fallback |= fallback_lengths[c] != 0;
+    }
+    if (has_fallback && (buildCanonicalCodes(fallback_lengths, bitCodes) != 0 || buildDecodeTable(fallback, bitCodes) != 0)) {
+        return -1;
+    }
+    for (int context = 0; context < MAX_CHARACTERS; context++) {
+        decoder->context_of[context] = fallback;
+        if (bitmap[context >> 3] & (1 << (context & 7))) {
+            struct DecodeTable *table = &decoder->context_tables[context];
+            if (readCodeLengths(input_file, lengths) != 0 || buildCanonicalCodes(lengths, bitCodes) != 0 ||
+                buildDecodeTable(table, bitCodes) != 0) {
+                return -1;
+            }
+            decoder->context_of[context] = table;
+        }
+    }
+    return 0;
+}
+
+// Function to write the container header, a static table is referenced by its id instead of its lengths;
+// returns the number of bytes written
+static uint64_t writeFileHeader(FILE *output_file, int flags, uint32_t block_size, uint64_t original_size,
+                         const unsigned char *lengths, const uint16_t *counts, uint32_t table_id) {
+    fwrite(FILE_MAGIC, 1, 4, output_file);
+    fputc(FORMAT_VERSION, output_file);
+    fputc(flags, output_file);
+    writeUint32(output_file, block_size);
+    writeUint64(output_file, original_size);
+    if (flags & FLAG_STATIC_TABLE) {
+        writeUint32(output_file, table_id);
+        return 22;
+    }
+    if (flags & FLAG_ANS) {
+        return 18 + writeAnsCounts(output_file, counts);
+    }
+    return 18 + writeCodeLengths(output_file, lengths);
+}
+
+// Function to derive a table id from its code lengths (32-bit FNV-1a), equal tables get equal ids
+static uint32_t tableId(const unsigned char *lengths) {
+    uint32_t hash = 2166136261u;
+    for (int c = 0; c < MAX_CHARACTERS; c++) {
+        hash = (hash ^ lengths[c]) * 16777619u;
+    }
+    return hash;
+}
+
+// Function to load a trained table file, returns -1 if it cannot be read or is invalid
+static int readTableFile(const char *filename, unsigned char *lengths, uint32_t *table_id) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    char magic[4];
+    int valid = fread(magic, 1, 4, file) == 4 && memcmp(magic, TABLE_MAGIC, 4) == 0 && fgetc(file) == FORMAT_VERSION &&
+                readUint32(file, table_id) == 0 && readCodeLengths(file, lengths) == 0 && tableId(lengths) == *table_id;
+    fclose(file);
+    return valid ? 0 : -1;
+}
+
+// Function to write one block header, its own code lengths or counts if it has any, then its payload;
+// returns the number of bytes written
+static uint64_t writeBlock(FILE *output_file, int kind, uint32_t original_bytes, uint32_t payload_bits,
+                    const unsigned char *lengths, const uint16_t *counts, const unsigned char *payload) {
+    uint64_t size = 9 + (payload_bits + 7) / 8;
+    fputc(kind, output_file);
+    writeUint32(output_file, original_bytes);
+    writeUint32(output_file, payload_bits);
+    if (kind == BLOCK_HUFFMAN_TABLE || kind == BLOCK_HUFFMAN_X4_TABLE) {
+        size += writeCodeLengths(output_file, lengths);
+    } else if (kind == BLOCK_ANS_TABLE) {
+        size += writeAnsCounts(output_file, counts);
+    }
+    if (payload_bits > 0) {
+        fwrite(payload, 1, (payload_bits + 7) / 8, output_file);
+    }
+    return size;
+}
+
+// Function to start a block index after a header of 'header_bytes' bytes
+static void initBlockIndex(struct BlockIndex *index, uint64_t header_bytes) {
+    index->entries = NULL;
+    index->count = 0;
+    index->capacity = 0;
+    index->original_position = 0;
+    index->file_position = header_bytes;
+}
+
+// Function to record a block of 'original_bytes' that took 'block_bytes' in the container
+static void addToBlockIndex(struct BlockIndex *index, uint32_t original_bytes, uint64_t block_bytes) {
+    if (original_bytes > 0) {
+        if (index->count == index->capacity) {
+            size_t capacity = index->capacity ? index->capacity * 2 : 64;
+            uint64_t *entries = (uint64_t *)realloc(index->entries, capacity * 2 * sizeof(uint64_t));
+            if (entries == NULL) {
+                fprintf(stderr, "Error: Out of memory\n");
+                exit(1);
+            }
+            index->entries = entries;
+            index->capacity = capacity;
+        }
+        index->entries[2 * index->count] = index->original_position;
+        index->entries[2 * index->count + 1] = index->file_position;
+        index->count++;
+    }
+    index->original_position += original_bytes;
+    index->file_position += block_bytes;
+}
+
+// Function to write the block index and its trailer after the end block, then release it
+static void writeBlockIndex(FILE *output_file, struct BlockIndex *index) {
+    for (size_t i = 0; i < 2 * index->count; i++) {
+        writeUint64(output_file, index->entries[i]);
+    }
+    writeUint32(output_file, (uint32_t)index->count);
+    writeUint64(output_file, index->file_position);
+    fwrite(INDEX_MAGIC, 1, 4, output_file);
+    free(index->entries);
+    index->entries = NULL;
+}
+
+// Function to open an output file, "-" is standard output
+static FILE *openOutput(const char *filename) {
+    return strcmp(filename, "-") == 0 ? stdout : fopen(filename, "wb");
+}
+
+// Function to compress a file, 'raw' writes the bare bitstream of the tree codes without the container
+static int compressFile(const char *input_filename, const char *output_filename, const struct CompressOptions *options) {
+    int raw = options->raw;
+    int threads = options->threads;
+
+    // Load the input once, both passes below read the same bytes
+    struct InputData input;
+    if (openInput(input_filename, &input) != 0) {
+        perror("Error opening input file");
+        return 1; // Exit with an error code
+    }
+    endPhase(PHASE_READ);
+
+    // Initialize an array of CharFrequency structs to store character frequencies
+    struct CharFrequency char_frequencies[MAX_CHARACTERS];
+    for (int i = 0; i < MAX_CHARACTERS; i++) {
+        char_frequencies[i].character = i;
+        char_frequencies[i].frequency = 0;
+    }
+
+    // Count the characters of the input
+    uint64_t original_size = input.size;
+    countFrequenciesParallel(input.data, input.size, threads, char_frequencies);
+    endPhase(PHASE_HISTOGRAM);
+
+    // Build the Huffman tree and the codes of its characters, or the tANS tables from the same histogram
+    struct HuffmanCode huffmanCodes[MAX_CHARACTERS];
+    struct BitCode bitCodes[MAX_CHARACTERS];
+    unsigned char lengths[MAX_CHARACTERS];
+    uint16_t counts[MAX_CHARACTERS];
+    struct AnsEncoder ans;
+    if (options->ans) {
+        normalizeAnsCounts(char_frequencies, counts);
+        if (original_size > 0) {
+            buildAnsEncoder(counts, &ans);
+        }
+        endPhase(PHASE_CODES);
+        memset(huffmanCodes, 0, sizeof(huffmanCodes));
+    } else {
+        buildCodes(char_frequencies, options->max_length, huffmanCodes, bitCodes);
+        if (!raw) {
+            useCanonicalCodes(huffmanCodes, bitCodes, lengths);
+        }
+    }
+    struct ContextCodes *contexts = NULL;
+    if (options->order1) {
+        contexts = buildContextCodes(input.data, input.size, options, bitCodes);
+        if (contexts == NULL) {
+            printf("Error: Out of memory\n");
+            return 1; // Exit with an error code
+        }
+    }
+
+    // Open the output file for writing
+    FILE *output_file = openOutput(output_filename); // Use binary mode for writing
+    if (output_file == NULL) {
+        perror("Error opening output file");
+        return 1; // Exit with an error code
+    }
+
+    uint64_t file_size = 0;
+    double encode_seconds = 0;
+    if (raw) {
+        // The bare bitstream is one continuous stream, so it is encoded on this thread
+        struct BitWriter writer;
+        if (initBitWriter(&writer, output_file) != 0) {
+            printf("Error: Out of memory\n");
+            return 1; // Exit with an error code
+        }
+        encodeBlock(&writer, bitCodes, input.data, input.size);
+
+        // Write any remaining bits in the accumulator to the output file
+        finishBitWriter(&writer);
+        endPhase(PHASE_ENCODE);
+    } else {
+        struct EncodeJob *jobs = (struct EncodeJob *)malloc(threads * sizeof(struct EncodeJob));
+        for (int t = 0; jobs != NULL && t < threads; t++) {
+            jobs[t].bitCodes = bitCodes;
+            if (initEncodeJob(&jobs[t], options->interleave) != 0) {
+                jobs = NULL;
+            } else if (options->ans) {
+                jobs[t].ans = &ans;
+            } else if (contexts != NULL) {
+                jobs[t].context_codes = contexts->codes_of;
+            }
+        }
+        if (jobs == NULL) {
+            printf("Error: Out of memory\n");
+            return 1; // Exit with an error code
+        }
+
+        // Encode 'threads' blocks at a time in parallel, then write them in input order
+        size_t block_size = options->block_size;
+        struct BlockIndex index;
+        int flags = FLAG_INDEXED | (options->ans ? FLAG_ANS : 0) | (contexts != NULL ? FLAG_ORDER1 : 0);
+        int kind = options->ans ? BLOCK_ANS : contexts != NULL ? BLOCK_HUFFMAN_ORDER1 :
+                   options->interleave ? BLOCK_HUFFMAN_X4 : BLOCK_HUFFMAN;
+        if (contexts != NULL) {
+            initBlockIndex(&index, writeFileHeader(output_file, flags, (uint32_t)block_size, original_size,
+                                                   contexts->lengths[MAX_CHARACTERS], NULL, 0) +
+                                   writeContextTables(output_file, contexts));
+        } else {
+            initBlockIndex(&index, writeFileHeader(output_file, flags, (uint32_t)block_size, original_size, lengths, counts, 0));
+        }
+        struct timespec started, finished;
+        clock_gettime(CLOCK_MONOTONIC, &started);
+        endPhase(PHASE_WRITE);
+        for (size_t offset = 0; offset < input.size; offset += (size_t)threads * block_size) {
+            int count = 0;
+            for (; count < threads && offset + (size_t)count * block_size < input.size; count++) {
+                size_t start = offset + (size_t)count * block_size;
+                jobs[count].data = input.data + start;
+                jobs[count].size = input.size - start < block_size ? input.size - start : block_size;
+            }
+            runJobs(encodeWorker, jobs, sizeof(struct EncodeJob), count);
+            endPhase(PHASE_ENCODE);
+            for (int t = 0; t < count; t++) {
+                addToBlockIndex(&index, (uint32_t)jobs[t].size,
+                                writeBlock(output_file, kind, (uint32_t)jobs[t].size,
+                                           jobs[t].payload_bits, NULL, NULL, jobs[t].writer.buffer));
+            }
+            endPhase(PHASE_WRITE);
+        }
+        addToBlockIndex(&index, 0, writeBlock(output_file, BLOCK_END, 0, 0, NULL, NULL, NULL));
+        file_size = index.file_position + 16 * index.count + 16;
+        writeBlockIndex(output_file, &index);
+        clock_gettime(CLOCK_MONOTONIC, &finished);
+        encode_seconds = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+
+        for (int t = 0; t < threads; t++) {
+            freeEncodeJob(&jobs[t]);
+        }
+        free(jobs);
+    }
+
+    // Print Huffman codes (or tANS counts) for characters, unless the compressed data itself goes to standard output
+    if (output_file != stdout) {
+        if (options->ans) {
+            printAnsCounts(counts, char_frequencies);
+        } else if (contexts != NULL) {
+            printContextSummary(contexts, original_size, file_size, encode_seconds);
+        } else {
+            printHuffmanCodes(huffmanCodes, char_frequencies);
+        }
+    }
+    freeHuffmanCodes(huffmanCodes);
+    free(contexts);
+
+    // // Calculate the sum of frequencies at the root node (should be the total frequency)
+    // int totalFrequency = huffmanRoot->frequency;
+    // printf("Total Frequency: %d\n", totalFrequency);
+
+    closeInput(&input); // Release the input
+    fclose(output_file); //Closes the output file
+    endPhase(PHASE_WRITE);
+
+    return 0;
+}
+
+// Function to compress a stream in fixed size blocks with one tree per block, using constant memory
+static int compressStream(const char *input_filename, const char *output_filename, const struct CompressOptions *options) {
+    FILE *input_file = strcmp(input_filename, "-") == 0 ? stdin : fopen(input_filename, "rb");
+    if (input_file == NULL) {
+        perror("Error opening input file");
+        return 1; // Exit with an error code
+    }
+    FILE *output_file = openOutput(output_filename);
+    if (output_file == NULL) {
+        perror("Error opening output file");
+        return 1; // Exit with an error code
+    }
+
+    struct EncodeJob job;
+    size_t block_size = options->block_size;
+    unsigned char *block = (unsigned char *)malloc(block_size);
+    struct AnsEncoder *ans = (struct AnsEncoder *)malloc(sizeof(struct AnsEncoder));
+    struct huff_ctx *huff = (struct huff_ctx *)malloc(sizeof(struct huff_ctx));
+    if (block == NULL || ans == NULL || huff == NULL || initEncodeJob(&job, options->interleave) != 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return 1; // Exit with an error code
+    }
+
+    // The size is not known up front, blocks carry their own tables and the end block marks the end
+    struct BlockIndex index;
+    initBlockIndex(&index, writeFileHeader(output_file, FLAG_STREAMED | FLAG_INDEXED | (options->ans ? FLAG_ANS : 0), (uint32_t)block_size, 0, NULL, NULL, 0));
+    size_t bytes_read;
+    while ((bytes_read = fread(block, 1, block_size, input_file)) > 0) {
+        endPhase(PHASE_READ);
+        struct CharFrequency char_frequencies[MAX_CHARACTERS];
+        for (int i = 0; i < MAX_CHARACTERS; i++) {
+            char_frequencies[i].character = i;
+            char_frequencies[i].frequency = 0;
+        }
+        countFrequencies(block, bytes_read, char_frequencies);
+        endPhase(PHASE_HISTOGRAM);
+
+        // A fresh tree (or tANS table) for every block follows the content as it shifts, built in the
+        // arena of one huff_ctx so blocks make no allocations
+        unsigned char lengths[MAX_CHARACTERS];
+        uint16_t counts[MAX_CHARACTERS];
+        int kind = options->interleave ? BLOCK_HUFFMAN_X4_TABLE : BLOCK_HUFFMAN_TABLE;
+        if (options->ans) {
+            normalizeAnsCounts(char_frequencies, counts);
+            buildAnsEncoder(counts, ans);
+            job.ans = ans;
+            kind = BLOCK_ANS_TABLE;
+            endPhase(PHASE_CODES);
+        } else {
+            uint64_t block_counts[MAX_CHARACTERS];
+            for (int c = 0; c < MAX_CHARACTERS; c++) {
+                block_counts[c] = char_frequencies[c].frequency;
+            }
+            huff_build(huff, block_counts, options->max_length);
+            memcpy(lengths, huff->lengths, MAX_CHARACTERS);
+            endPhase(PHASE_TREE);
+        }
+
+        job.bitCodes = huff->codes;
+        job.data = block;
+        job.size = bytes_read;
+        encodeWorker(&job);
+        endPhase(PHASE_ENCODE);
+        addToBlockIndex(&index, (uint32_t)bytes_read,
+                        writeBlock(output_file, kind, (uint32_t)bytes_read, job.payload_bits, lengths, counts, job.writer.buffer));
+        endPhase(PHASE_WRITE);
+    }
+    addToBlockIndex(&index, 0, writeBlock(output_file, BLOCK_END, 0, 0, NULL, NULL, NULL));
+    writeBlockIndex(output_file, &index);
+
+    freeEncodeJob(&job);
+    free(ans);
+    free(huff);
+    free(block);
+    if (input_file != stdin) {
+        fclose(input_file);
+    }
+    int status = fclose(output_file) == 0 ? 0 : 1;
+    endPhase(PHASE_WRITE);
+    return status;
+}
+
+// Function to train a code table on a sample corpus and save it for batch compression
+static int trainTable(const char *corpus_filename, const char *table_filename, const struct CompressOptions *options) {
+    struct InputData input;
+    if (openInput(corpus_filename, &input) != 0) {
+        perror("Error opening input file");
+        return 1; // Exit with an error code
+    }
+
+    // Every character gets a code, so files with characters the corpus lacks can still be coded
+    struct CharFrequency char_frequencies[MAX_CHARACTERS];
+    for (int i = 0; i < MAX_CHARACTERS; i++) {
+        char_frequencies[i].character = i;
+        char_frequencies[i].frequency = 1;
+    }
+    countFrequenciesParallel(input.data, input.size, options->threads, char_frequencies);
+    closeInput(&input);
+
+    struct HuffmanCode huffmanCodes[MAX_CHARACTERS];
+    struct BitCode bitCodes[MAX_CHARACTERS];
+    unsigned char lengths[MAX_CHARACTERS];
+    buildCodes(char_frequencies, options->max_length, huffmanCodes, bitCodes);
+    useCanonicalCodes(huffmanCodes, bitCodes, lengths);
+
+    FILE *table_file = fopen(table_filename, "wb");
+    if (table_file == NULL) {
+        perror("Error opening output file");
+        return 1; // Exit with an error code
+    }
+    uint32_t table_id = tableId(lengths);
+    fwrite(TABLE_MAGIC, 1, 4, table_file);
+    fputc(FORMAT_VERSION, table_file);
+    writeUint32(table_file, table_id);
+    writeCodeLengths(table_file, lengths);
+    fclose(table_file);
+
+    printHuffmanCodes(huffmanCodes, char_frequencies);
+    printf("Table id: %08x\n", table_id);
+    freeHuffmanCodes(huffmanCodes);
+    return 0;
+}
+
+// Function to compress many files with one trained table: each file is read once and coded
+// straight away, without a histogram or tree, into <file>.huf
+static int compressBatch(const char *table_filename, char **filenames, int count, const struct CompressOptions *options) {
+    unsigned char lengths[MAX_CHARACTERS];
+    uint32_t table_id;
+    struct BitCode bitCodes[MAX_CHARACTERS];
+    if (readTableFile(table_filename, lengths, &table_id) != 0 || buildCanonicalCodes(lengths, bitCodes) != 0) {
+        printf("Error: '%s' is not a valid table file\n", table_filename);
+        return 1; // Exit with an error code
+    }
+
+    // One input buffer and one encoder are reused for every file
+    struct EncodeJob job;
+    unsigned char *buffer = NULL;
+    size_t capacity = 0;
+    if (initEncodeJob(&job, options->interleave) != 0) {
+        printf("Error: Out of memory\n");
+        return 1; // Exit with an error code
+    }
+    job.bitCodes = bitCodes;
+
+    int failures = 0;
+    uint64_t total_in = 0, total_out = 0;
+    for (int f = 0; f < count; f++) {
+        int fd = open(filenames[f], O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0 || reserveBuffer(&buffer, &capacity, (size_t)info.st_size) != 0) {
+            perror(filenames[f]);
+            failures++;
+            if (fd >= 0) {
+                close(fd);
+            }
+            continue;
+        }
+        size_t size = 0;
+        ssize_t bytes_read;
+        while (size < (size_t)info.st_size && (bytes_read = read(fd, buffer + size, (size_t)info.st_size - size)) > 0) {
+            size += (size_t)bytes_read;
+        }
+        close(fd);
+        endPhase(PHASE_READ);
+
+        char output_filename[4096];
+        snprintf(output_filename, sizeof(output_filename), "%s.huf", filenames[f]);
+        FILE *output_file = fopen(output_filename, "wb");
+        if (output_file == NULL) {
+            perror(output_filename);
+            failures++;
+            continue;
+        }
+        size_t block_size = options->block_size;
+        struct BlockIndex index;
+        initBlockIndex(&index, writeFileHeader(output_file, FLAG_STATIC_TABLE | FLAG_INDEXED, (uint32_t)block_size, size, NULL, NULL, table_id));
+        for (size_t offset = 0; offset < size; offset += block_size) {
+            job.data = buffer + offset;
+            job.size = size - offset < block_size ? size - offset : block_size;
+            encodeWorker(&job);
+            endPhase(PHASE_ENCODE);
+            addToBlockIndex(&index, (uint32_t)job.size,
+                            writeBlock(output_file, options->interleave ? BLOCK_HUFFMAN_X4 : BLOCK_HUFFMAN, (uint32_t)job.size,
+                                       job.payload_bits, NULL, NULL, job.writer.buffer));
+            endPhase(PHASE_WRITE);
+        }
+        addToBlockIndex(&index, 0, writeBlock(output_file, BLOCK_END, 0, 0, NULL, NULL, NULL));
+        writeBlockIndex(output_file, &index);
+        total_in += size;
+        total_out += (uint64_t)ftell(output_file);
+        fclose(output_file);
+        endPhase(PHASE_WRITE);
+    }
+
+    printf("Compressed %d files with table %08x: %llu -> %llu bytes\n", count - failures, table_id,
+           (unsigned long long)total_in, (unsigned long long)total_out);
+    freeEncodeJob(&job);
+    free(buffer);
+    return failures == 0 ? 0 : 1;
+}
+
+// Function to decode a single stream payload, checking it uses exactly 'payload_bits' bits
+static int decodeSinglePayload(const unsigned char *payload, uint32_t payload_bits, const struct DecodeTable *table,
+                        unsigned char *output, size_t length) {
+    struct BitReader reader;
+    initBitReader(&reader, payload, ((size_t)payload_bits + 7) / 8);
+    if (decodeBlock(&reader, table, output, length) != 0 || bitsConsumed(&reader) != payload_bits) {
+        return -1;
+    }
+    return 0;
+}
+
+// Function to decode an interleaved payload, checking every sub-stream against the jump table
+static int decodeInterleavedPayload(const unsigned char *payload, uint32_t payload_bits, const struct DecodeTable *table,
+                             unsigned char *output, size_t length) {
+    size_t payload_bytes = ((size_t)payload_bits + 7) / 8;
+    size_t offset = 4 * INTERLEAVED_STREAMS;
+    uint32_t stream_bits[INTERLEAVED_STREAMS];
+    struct BitReader readers[INTERLEAVED_STREAMS];
+    if (payload_bytes < offset) {
+        return -1;
+    }
+    for (int k = 0; k < INTERLEAVED_STREAMS; k++) {
+        const unsigned char *in = payload + 4 * k;
+        stream_bits[k] = (uint32_t)in[0] | ((uint32_t)in[1] << 8) | ((uint32_t)in[2] << 16) | ((uint32_t)in[3] << 24);
+    }
+    for (int k = 0; k < INTERLEAVED_STREAMS; k++) {
+        size_t stream_bytes = ((size_t)stream_bits[k] + 7) / 8;
+        if (stream_bytes > payload_bytes - offset) {
+            return -1;
+        }
+        initBitReader(&readers[k], payload + offset, stream_bytes);
+        offset += stream_bytes;
+    }
+    if ((offset - (stream_bits[INTERLEAVED_STREAMS - 1] + 7) / 8) * 8 + stream_bits[INTERLEAVED_STREAMS - 1] != payload_bits) {
+        return -1;
+    }
+    if (decodeInterleavedBlock(readers, table, output, length) != 0) {
+        return -1;
+    }
+    for (int k = 0; k < INTERLEAVED_STREAMS; k++) {
+        if (bitsConsumed(&readers[k]) != stream_bits[k]) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int startDecoder(struct Decoder *decoder, FILE *input_file, const char *input_filename, const char *table_filename);
+
+// Function to open a container and read its header, returns -1 after printing the reason
+static int openDecoder(struct Decoder *decoder, const char *input_filename, const char *table_filename) {
+    FILE *input_file = strcmp(input_filename, "-") == 0 ? stdin : fopen(input_filename, "rb");
+    if (input_file == NULL) {
+        memset(decoder, 0, sizeof(*decoder));
+        perror("Error opening input file");
+        return -1;
+    }
+    return startDecoder(decoder, input_file, input_filename, table_filename);
+}
+
+// Function to read the container header from an open file (closed again by closeDecoder), returns -1
+// after printing the reason
+static int startDecoder(struct Decoder *decoder, FILE *input_file, const char *input_filename, const char *table_filename) {
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->input_filename = input_filename;
+    decoder->input_file = input_file;
+
+    // Read the header and the code lengths
+    char magic[4];
+    int version = -1;
+    unsigned char lengths[MAX_CHARACTERS];
+    if (fread(magic, 1, 4, input_file) != 4 || memcmp(magic, FILE_MAGIC, 4) != 0) {
+        fprintf(stderr, "Error: '%s' is not a compressed file\n", input_filename);
+        return -1;
+    }
+    version = fgetc(input_file);
+    decoder->flags = fgetc(input_file);
+    if (version != FORMAT_VERSION || (decoder->flags & ~(FLAG_STREAMED | FLAG_STATIC_TABLE | FLAG_INDEXED | FLAG_ANS | FLAG_ORDER1)) != 0) {
+        fprintf(stderr, "Error: Unsupported format version %d in '%s'\n", version, input_filename);
+        return -1;
+    }
+    uint32_t table_id = 0, loaded_id = 0;
+    uint16_t counts[MAX_CHARACTERS];
+    if (readUint32(input_file, &decoder->block_size) != 0 || readUint64(input_file, &decoder->original_size) != 0 ||
+        ((decoder->flags & FLAG_STATIC_TABLE) ? readUint32(input_file, &table_id) :
+         (decoder->flags & FLAG_ANS) ? readAnsCounts(input_file, counts) : readCodeLengths(input_file, lengths)) != 0) {
+        fprintf(stderr, "Error: Truncated header in '%s'\n", input_filename);
+        return -1;
+    }
+
+    endPhase(PHASE_READ);
+
+    // A file coded with a trained table needs that table (-D) to be decoded
+    if (decoder->flags & FLAG_STATIC_TABLE) {
+        if (table_filename == NULL || readTableFile(table_filename, lengths, &loaded_id) != 0 || loaded_id != table_id) {
+            fprintf(stderr, "Error: '%s' needs trained table %08x (-D table_filename)\n", input_filename, table_id);
+            return -1;
+        }
+    }
+
+    // Canonical codes rebuild the decode table straight from the lengths, without a tree
+    struct BitCode bitCodes[MAX_CHARACTERS];
+    decoder->has_table = decoder->original_size > 0 && !(decoder->flags & FLAG_STREAMED);
+    if (decoder->flags & FLAG_ANS) {
+        if (decoder->has_table && buildAnsDecodeTable(counts, decoder->ans_table) != 0) {
+            fprintf(stderr, "Error: Invalid tANS table in '%s'\n", input_filename);
+            return -1;
+        }
+        endPhase(PHASE_CODES);
+        return 0;
+    }
+    if (decoder->flags & FLAG_ORDER1) {
+        if (readContextTables(input_file, decoder, lengths) != 0) {
+            fprintf(stderr, "Error: Invalid order-1 tables in '%s'\n", input_filename);
+            return -1;
+        }
+        endPhase(PHASE_CODES);
+        return 0;
+    }
+    if (buildCanonicalCodes(lengths, bitCodes) != 0 || (decoder->has_table && buildDecodeTable(&decoder->table, bitCodes) != 0)) {
+        fprintf(stderr, "Error: Invalid code table in '%s'\n", input_filename);
+        return -1;
+    }
+    endPhase(PHASE_CODES);
+    return 0;
+}
+
+// Function to decode the next block into decoder->output; returns 1 with its length in 'length',
+// 0 at the end block, or -1 after printing the reason
+static int decodeNextBlock(struct Decoder *decoder, size_t *length) {
+    FILE *input_file = decoder->input_file;
+    const char *input_filename = decoder->input_filename;
+    int kind = fgetc(input_file);
+    uint32_t original_bytes, payload_bits;
+    if (kind == EOF || readUint32(input_file, &original_bytes) != 0 || readUint32(input_file, &payload_bits) != 0) {
+        fprintf(stderr, "Error: Truncated block in '%s'\n", input_filename);
+        return -1;
+    }
+    if (kind == BLOCK_END) {
+        return 0;
+    }
+    size_t payload_bytes = ((size_t)payload_bits + 7) / 8;
+    int interleaved = kind == BLOCK_HUFFMAN_X4 || kind == BLOCK_HUFFMAN_X4_TABLE;
+    const struct DecodeTable *table = &decoder->table;
+    const struct AnsDecodeEntry *ans_table = NULL;
+    if (kind == BLOCK_ANS_TABLE) {
+        uint16_t counts[MAX_CHARACTERS];
+        if (readAnsCounts(input_file, counts) != 0 || buildAnsDecodeTable(counts, decoder->ans_block_table) != 0) {
+            fprintf(stderr, "Error: Invalid tANS table in '%s'\n", input_filename);
+            return -1;
+        }
+        ans_table = decoder->ans_block_table;
+    } else if (kind == BLOCK_ANS) {
+        if (!decoder->has_table || !(decoder->flags & FLAG_ANS)) {
+            fprintf(stderr, "Error: Corrupt block in '%s'\n", input_filename);
+            return -1;
+        }
+        ans_table = decoder->ans_table;
+    } else if (kind == BLOCK_HUFFMAN_ORDER1) {
+        if (!decoder->has_table || !(decoder->flags & FLAG_ORDER1)) {
+            fprintf(stderr, "Error: Corrupt block in '%s'\n", input_filename);
+            return -1;
+        }
+    } else if (kind == BLOCK_HUFFMAN_TABLE || kind == BLOCK_HUFFMAN_X4_TABLE) {
+        // The block brings its own code lengths, the table is rebuilt from them
+        unsigned char lengths[MAX_CHARACTERS];
+        struct BitCode bitCodes[MAX_CHARACTERS];
+        free(decoder->block_table.entries);
+        decoder->block_table.entries = NULL;
+        if (readCodeLengths(input_file, lengths) != 0 || buildCanonicalCodes(lengths, bitCodes) != 0 ||
+            buildDecodeTable(&decoder->block_table, bitCodes) != 0) {
+            fprintf(stderr, "Error: Invalid code table in '%s'\n", input_filename);
+            return -1;
+        }
+        table = &decoder->block_table;
+    } else if ((kind != BLOCK_HUFFMAN && kind != BLOCK_HUFFMAN_X4) || !decoder->has_table || (decoder->flags & (FLAG_ANS | FLAG_ORDER1))) {
+        fprintf(stderr, "Error: Corrupt block in '%s'\n", input_filename);
+        return -1;
+    }
+    if (original_bytes > decoder->block_size) {
+        fprintf(stderr, "Error: Corrupt block in '%s'\n", input_filename);
+        return -1;
+    }
+    if (reserveBuffer(&decoder->payload, &decoder->payload_capacity, payload_bytes) != 0 ||
+        reserveBuffer(&decoder->output, &decoder->output_capacity, original_bytes) != 0) {
+        fprintf(stderr, "Error: Out of memory\n");
+        return -1;
+    }
+    if (fread(decoder->payload, 1, payload_bytes, input_file) != payload_bytes) {
+        fprintf(stderr, "Error: Truncated block in '%s'\n", input_filename);
+        return -1;
+    }
+    endPhase(PHASE_READ);
+
+    if (ans_table != NULL ? decodeAnsPayload(decoder->payload, payload_bits, ans_table, decoder->output, original_bytes) != 0
+        : kind == BLOCK_HUFFMAN_ORDER1 ? decodeContextPayload(decoder->payload, payload_bits, decoder->context_of, decoder->output, original_bytes) != 0
+        : interleaved ? decodeInterleavedPayload(decoder->payload, payload_bits, table, decoder->output, original_bytes) != 0
+                      : decodeSinglePayload(decoder->payload, payload_bits, table, decoder->output, original_bytes) != 0) {
+        fprintf(stderr, "Error: Corrupt data in '%s'\n", input_filename);
+        return -1;
+    }
+    endPhase(PHASE_DECODE);
+    *length = original_bytes;
+    return 1;
+}
+
+// Function to release a decoder
+static void closeDecoder(struct Decoder *decoder) {
+    free(decoder->table.entries);
+    free(decoder->block_table.entries);
+    if (decoder->context_tables != NULL) {
+        for (int context = 0; context <= MAX_CHARACTERS; context++) {
+            free(decoder->context_tables[context].entries);
+        }
+        free(decoder->context_tables);
+    }
+    free(decoder->payload);
+    free(decoder->output);
+    if (decoder->input_file != NULL && decoder->input_file != stdin) {
+        fclose(decoder->input_file);
+    }
+}
+
+// Function to decompress a file written by compressFile, one block at a time
+static int decompressFile(const char *input_filename, const char *output_filename, const char *table_filename) {
+    struct Decoder decoder;
+    if (openDecoder(&decoder, input_filename, table_filename) != 0) {
+        return 1; // Exit with an error code
+    }
+
+    FILE *output_file = openOutput(output_filename);
+    if (output_file == NULL) {
+        perror("Error opening output file");
+        return 1; // Exit with an error code
+    }
+
+    // Decode block by block, so memory stays bounded by the block size
+    uint64_t decoded_size = 0;
+    size_t length;
+    int status;
+    while ((status = decodeNextBlock(&decoder, &length)) > 0) {
+        fwrite(decoder.output, 1, length, output_file);
+        endPhase(PHASE_WRITE);
+        decoded_size += length;
+    }
+    if (status < 0) {
+        return 1; // Exit with an error code
+    }
+    if (!(decoder.flags & FLAG_STREAMED) && decoded_size != decoder.original_size) {
+        fprintf(stderr, "Error: '%s' decoded to %llu bytes, expected %llu\n", input_filename,
+               (unsigned long long)decoded_size, (unsigned long long)decoder.original_size);
+        return 1; // Exit with an error code
+    }
+
+    closeDecoder(&decoder);
+    int status_close = fclose(output_file) == 0 ? 0 : 1;
+    endPhase(PHASE_WRITE);
+    return status_close;
+}
+
+// Function to decode only original bytes [start, start + length) by seeking through the block index
+static int decompressRange(const char *input_filename, const char *output_filename, const char *table_filename,
+                    uint64_t start, uint64_t length) {
+    struct Decoder decoder;
+    if (openDecoder(&decoder, input_filename, table_filename) != 0) {
+        return 1; // Exit with an error code
+    }
+    FILE *input_file = decoder.input_file;
+
+    // The trailer at the end of the file locates the index
+    unsigned char trailer[16];
+    uint32_t count = 0;
+    uint64_t index_offset = 0;
+    if (!(decoder.flags & FLAG_INDEXED) || fseek(input_file, -16, SEEK_END) != 0 || fread(trailer, 1, 16, input_file) != 16 ||
+        memcmp(trailer + 12, INDEX_MAGIC, 4) != 0) {
+        fprintf(stderr, "Error: '%s' has no block index (or is not seekable)\n", input_filename);
+        return 1; // Exit with an error code
+    }
+    for (int b = 3; b >= 0; b--) {
+        count = (count << 8) | trailer[b];
+    }
+    for (int b = 11; b >= 4; b--) {
+        index_offset = (index_offset << 8) | trailer[b];
+    }
+
+    // Binary search over the index read straight from the file for the block holding 'start'
+    uint64_t entry[2] = { 0, 0 };
+    uint32_t low = 0, high = count;
+    while (high - low > 1) {
+        uint32_t middle = low + (high - low) / 2;
+        uint64_t original_offset;
+        if (fseek(input_file, (long)(index_offset + 16 * (uint64_t)middle), SEEK_SET) != 0 ||
+            readUint64(input_file, &original_offset) != 0) {
+            fprintf(stderr, "Error: Corrupt block index in '%s'\n", input_filename);
+            return 1; // Exit with an error code
+        }
+        if (original_offset <= start) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    // A start in the last block must also be inside it: the block header holds its original bytes
+    uint32_t last_bytes = 0;
+    if (count == 0 || fseek(input_file, (long)(index_offset + 16 * (uint64_t)low), SEEK_SET) != 0 ||
+        readUint64(input_file, &entry[0]) != 0 || readUint64(input_file, &entry[1]) != 0 ||
+        (low == count - 1 && (fseek(input_file, (long)entry[1] + 1, SEEK_SET) != 0 || readUint32(input_file, &last_bytes) != 0 ||
+                              start >= entry[0] + last_bytes)) ||
+        fseek(input_file, (long)entry[1], SEEK_SET) != 0) {
+        fprintf(stderr, "Error: Range start %llu is past the end of '%s'\n", (unsigned long long)start, input_filename);
+        return 1; // Exit with an error code
+    }
+
+    FILE *output_file = openOutput(output_filename);
+    if (output_file == NULL) {
+        perror("Error opening output file");
+        return 1; // Exit with an error code
+    }
+
+    // Decode from that block on until the range is covered
+    uint64_t position = entry[0];
+    size_t block_length;
+    int status = 1;
+    while (length > 0 && (status = decodeNextBlock(&decoder, &block_length)) > 0) {
+        if (position + block_length > start) {
+            size_t skip = start > position ? (size_t)(start - position) : 0;
+            size_t take = block_length - skip < length ? block_length - skip : (size_t)length;
+            fwrite(decoder.output + skip, 1, take, output_file);
+            endPhase(PHASE_WRITE);
+            start += take;
+            length -= take;
+        }
+        position += block_length;
+    }
+    if (status < 0) {
+        return 1; // Exit with an error code
+    }
+
+    closeDecoder(&decoder);
+    int status_close = fclose(output_file) == 0 ? 0 : 1;
+    endPhase(PHASE_WRITE);
+    return status_close;
+}
+
+// Function to add a file, or every regular file below a directory, to the members of an archive
+static int addArchiveInputs(const char *path, struct ArchiveMember **members, int *count, int *capacity) {
+    struct stat info;
+    if (stat(path, &info) != 0) {
+        perror(path);
+        return -1;
+    }
+    if (S_ISDIR(info.st_mode)) {
+        DIR *directory = opendir(path);
+        if (directory == NULL) {
+            perror(path);
+            return -1;
+        }
+        struct dirent *entry;
+        int status = 0;
+        while ((entry = readdir(directory)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+            char child[4096];
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+            status |= addArchiveInputs(child, members, count, capacity);
+        }
+        closedir(directory);
+        return status;
+    }
+    if (!S_ISREG(info.st_mode)) {
+        return 0; // Links to devices, sockets and the like are left out
+    }
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        struct ArchiveMember *grown = (struct ArchiveMember *)realloc(*members, *capacity * sizeof(struct ArchiveMember));
+        if (grown == NULL) {
+            return -1;
+        }
+        *members = grown;
+    }
+    (*members)[*count].name = strdup(path);
+    (*members)[*count].original_size = (uint64_t)info.st_size;
+    (*count)++;
+    return 0;
+}
+
+// Function to take the next member for a pool thread, -1 when all are taken
+static int takeArchiveMember(struct ArchivePool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    int member = pool->next < pool->count ? pool->next++ : -1;
+    pthread_mutex_unlock(&pool->lock);
+    return member;
+}
+
+// Function to count a member that failed
+static void failArchiveMember(struct ArchivePool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool->failures++;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// Function to compress one file into a complete container in memory, with its own code table
+static int compressMember(struct ArchiveMember *member, struct EncodeJob *job, const struct CompressOptions *options,
+                   char **buffer, size_t *size) {
+    struct InputData input;
+    if (openInput(member->name, &input) != 0) {
+        perror(member->name);
+        return -1;
+    }
+    member->original_size = input.size;
+    endPhase(PHASE_READ);
+
+    struct CharFrequency char_frequencies[MAX_CHARACTERS];
+    uint64_t counts[MAX_CHARACTERS];
+    for (int i = 0; i < MAX_CHARACTERS; i++) {
+        char_frequencies[i].character = i;
+        char_frequencies[i].frequency = 0;
+    }
+    countFrequencies(input.data, input.size, char_frequencies);
+    for (int i = 0; i < MAX_CHARACTERS; i++) {
+        counts[i] = char_frequencies[i].frequency;
+    }
+    endPhase(PHASE_HISTOGRAM);
+    struct huff_ctx huff;
+    huff_build(&huff, counts, options->max_length);
+    endPhase(PHASE_TREE);
+
+    FILE *output_file = open_memstream(buffer, size);
+    if (output_file == NULL) {
+        closeInput(&input);
+        return -1;
+    }
+    size_t block_size = options->block_size;
+    struct BlockIndex index;
+    initBlockIndex(&index, writeFileHeader(output_file, FLAG_INDEXED, (uint32_t)block_size, input.size, huff.lengths, NULL, 0));
+    job->bitCodes = huff.codes;
+    for (size_t offset = 0; offset < input.size; offset += block_size) {
+        job->data = input.data + offset;
+        job->size = input.size - offset < block_size ? input.size - offset : block_size;
+        encodeWorker(job);
+        endPhase(PHASE_ENCODE);
+        addToBlockIndex(&index, (uint32_t)job->size,
+                        writeBlock(output_file, options->interleave ? BLOCK_HUFFMAN_X4 : BLOCK_HUFFMAN, (uint32_t)job->size,
+                                   job->payload_bits, NULL, NULL, job->writer.buffer));
+    }
+    addToBlockIndex(&index, 0, writeBlock(output_file, BLOCK_END, 0, 0, NULL, NULL, NULL));
+    writeBlockIndex(output_file, &index);
+    closeInput(&input);
+    return fclose(output_file) == 0 ? 0 : -1;
+}
+
+// Thread function to compress members until none are left, appending each to the archive when done
+static void *archiveWorker(void *argument) {
+    struct ArchivePool *pool = *(struct ArchivePool **)argument;
+    struct EncodeJob job;
+    if (initEncodeJob(&job, pool->options->interleave) != 0) {
+        failArchiveMember(pool);
+        return NULL;
+    }
+    int m;
+    while ((m = takeArchiveMember(pool)) >= 0) {
+        struct ArchiveMember *member = &pool->members[m];
+        char *buffer = NULL;
+        size_t size = 0;
+        if (compressMember(member, &job, pool->options, &buffer, &size) != 0) {
+            failArchiveMember(pool);
+            free(buffer);
+            continue;
+        }
+        // Members go into the archive in the order they finish, the directory records where
+        pthread_mutex_lock(&pool->lock);
+        member->offset = pool->position;
+        member->size = size;
+        pool->position += size;
+        fwrite(buffer, 1, size, pool->archive_file);
+        pthread_mutex_unlock(&pool->lock);
+        free(buffer);
+        endPhase(PHASE_WRITE);
+    }
+    freeEncodeJob(&job);
+    return NULL;
+}
+
+// Function to give the name a member is stored under: the path relative to the extraction directory, as tar
+// does, without leading '/' and './' and without everything up to the last '..' component, which is counted
+// in 'parents_removed'
+static const char *storedMemberName(const char *path, int *parents_removed) {
+    const char *name = path;
+    for (const char *parent = strstr(path, ".."); parent != NULL; parent = strstr(parent + 2, "..")) {
+        if ((parent == path || parent[-1] == '/') && (parent[2] == '/' || parent[2] == '\0')) {
+            name = parent + 2;
+            (*parents_removed)++;
+        }
+    }
+    while (name[0] == '/' || (name[0] == '.' && name[1] == '/')) {
+        name += name[0] == '/' ? 1 : 2;
+    }
+    return name;
+}
+
+// Function to compress files and directory trees into one archive, one member per file on a pool of threads
+static int createArchive(const char *archive_filename, char **filenames, int count, const struct CompressOptions *options) {
+    struct ArchivePool pool;
+    memset(&pool, 0, sizeof(pool));
+    int capacity = 0;
+    for (int f = 0; f < count; f++) {
+        if (addArchiveInputs(filenames[f], &pool.members, &pool.count, &capacity) != 0) {
+            pool.failures++;
+        }
+    }
+    FILE *archive_file = openOutput(archive_filename);
+    if (archive_file == NULL) {
+        perror("Error opening output file");
+        return 1; // Exit with an error code
+    }
+    fwrite(ARCHIVE_MAGIC, 1, 4, archive_file);
+    fputc(FORMAT_VERSION, archive_file);
+    pool.position = 5;
+    pool.archive_file = archive_file;
+    pool.options = options;
+    pthread_mutex_init(&pool.lock, NULL);
+
+    int threads = options->threads < pool.count ? options->threads : (pool.count > 0 ? pool.count : 1);
+    struct ArchivePool *jobs[MAX_THREADS];
+    for (int t = 0; t < threads; t++) {
+        jobs[t] = &pool;
+    }
+    runJobs(archiveWorker, jobs, sizeof(struct ArchivePool *), threads);
+    pthread_mutex_destroy(&pool.lock);
+
+    // Central directory, members that failed are left out. So are later members stored under a name already
+    // written ('./f' and 'x/../f' both become 'f'), as extracting both would decode them into the same file
+    uint64_t directory_offset = pool.position;
+    uint32_t written = 0;
+    uint64_t total_in = 0;
+    int parents_removed = 0;
+    for (int m = 0; m < pool.count; m++) {
+        struct ArchiveMember *member = &pool.members[m];
+        if (member->size > 0) {
+            const char *name = storedMemberName(member->name, &parents_removed);
+            int duplicate = -1;
+            for (int d = 0; d < m && duplicate < 0; d++) {
+                int unused = 0;
+                if (pool.members[d].size > 0 && strcmp(storedMemberName(pool.members[d].name, &unused), name) == 0) {
+                    duplicate = d;
+                }
+            }
+            if (duplicate >= 0) {
+                fprintf(stderr, "Error: '%s' would be stored as '%s' like '%s', leaving it out\n", member->name, name,
+                        pool.members[duplicate].name);
+                pool.failures++;
+                continue;
+            }
+            writeUint16(archive_file, (uint16_t)strlen(name));
+            fwrite(name, 1, strlen(name), archive_file);
+            writeUint64(archive_file, member->original_size);
+            writeUint64(archive_file, member->offset);
+            writeUint64(archive_file, member->size);
+            total_in += member->original_size;
+            written++;
+        }
+    }
+    for (int m = 0; m < pool.count; m++) {
+        free(pool.members[m].name);
+    }
+    if (parents_removed) {
+        fprintf(stderr, "Removing leading '../' from member names\n");
+    }
+    writeUint32(archive_file, written);
+    writeUint64(archive_file, directory_offset);
+    fwrite(ARCHIVE_MAGIC, 1, 4, archive_file);
+    free(pool.members);
+    if (fclose(archive_file) != 0) {
+        perror(archive_filename);
+        return 1; // Exit with an error code
+    }
+    if (archive_file != stdout) {
+        printf("%u files, %llu bytes archived into %llu bytes\n", written, (unsigned long long)total_in,
+               (unsigned long long)directory_offset);
+    }
+    return pool.failures > 0 ? 1 : 0;
+}
+
+// Function to create the directories on the path of a file
+static void makeParentDirectories(const char *path) {
+    char partial[4096];
+    for (const char *slash = strchr(path, '/'); slash != NULL; slash = strchr(slash + 1, '/')) {
+        if (slash > path && (size_t)(slash - path) < sizeof(partial)) {
+            memcpy(partial, path, (size_t)(slash - path));
+            partial[slash - path] = '\0';
+            mkdir(partial, 0777);
+        }
+    }
+}
+
+// Function to decode one member from the archive into the extraction directory
+static int extractMember(struct ArchivePool *pool, FILE *archive_file, const struct ArchiveMember *member) {
+    // Names that would leave the extraction directory are refused
+    const char *name = member->name;
+    if (name[0] == '/' || strcmp(name, "..") == 0 || strncmp(name, "../", 3) == 0 || strstr(name, "/../") != NULL ||
+        (strlen(name) >= 3 && strcmp(name + strlen(name) - 3, "/..") == 0)) {
+        fprintf(stderr, "Error: Refusing to extract '%s'\n", name);
+        return -1;
+    }
+    char output_filename[4096];
+    snprintf(output_filename, sizeof(output_filename), "%s/%s", pool->directory, name);
+
+    // The member is read whole and decoded from memory with the regular container decoder
+    char *buffer = (char *)malloc(member->size);
+    if (buffer == NULL || fseeko(archive_file, (off_t)member->offset, SEEK_SET) != 0 ||
+        fread(buffer, 1, member->size, archive_file) != member->size) {
+        fprintf(stderr, "Error: Truncated archive '%s'\n", pool->archive_filename);
+        free(buffer);
+        return -1;
+    }
+    FILE *member_file = fmemopen(buffer, member->size, "rb");
+    struct Decoder decoder;
+    if (member_file == NULL) {
+        free(buffer);
+        return -1;
+    }
+    if (startDecoder(&decoder, member_file, name, NULL) != 0) {
+        closeDecoder(&decoder); // Also closes member_file
+        free(buffer);
+        return -1;
+    }
+    makeParentDirectories(output_filename);
+    FILE *output_file = fopen(output_filename, "wb");
+    if (output_file == NULL) {
+        perror(output_filename);
+        closeDecoder(&decoder);
+        free(buffer);
+        return -1;
+    }
+    uint64_t decoded_size = 0;
+    size_t length;
+    int status;
+    while ((status = decodeNextBlock(&decoder, &length)) > 0) {
+        fwrite(decoder.output, 1, length, output_file);
+        decoded_size += length;
+        endPhase(PHASE_WRITE);
+    }
+    closeDecoder(&decoder);
+    free(buffer);
+    if (fclose(output_file) != 0 || status < 0 || decoded_size != member->original_size) {
+        fprintf(stderr, "Error: Could not extract '%s'\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+// Thread function to extract members until none are left, each thread reads through its own file handle
+static void *extractWorker(void *argument) {
+    struct ArchivePool *pool = *(struct ArchivePool **)argument;
+    FILE *archive_file = fopen(pool->archive_filename, "rb");
+    if (archive_file == NULL) {
+        perror(pool->archive_filename);
+        failArchiveMember(pool);
+        return NULL;
+    }
+    int m;
+    while ((m = takeArchiveMember(pool)) >= 0) {
+        if (extractMember(pool, archive_file, &pool->members[m]) != 0) {
+            failArchiveMember(pool);
+        }
+    }
+    fclose(archive_file);
+    return NULL;
+}
+
+// Function to extract every member of an archive into a directory on a pool of threads
+static int extractArchive(const char *archive_filename, const char *directory, int threads) {
+    FILE *archive_file = fopen(archive_filename, "rb");
+    if (archive_file == NULL) {
+        perror("Error opening input file");
+        return 1; // Exit with an error code
+    }
+
+    // The trailer at the end of the file locates the central directory
+    unsigned char trailer[16];
+    uint32_t count = 0;
+    uint64_t directory_offset = 0;
+    if (fseeko(archive_file, -16, SEEK_END) != 0 || fread(trailer, 1, 16, archive_file) != 16 ||
+        memcmp(trailer + 12, ARCHIVE_MAGIC, 4) != 0) {
+        fprintf(stderr, "Error: '%s' is not an archive\n", archive_filename);
+        return 1; // Exit with an error code
+    }
+    for (int b = 3; b >= 0; b--) {
+        count = (count << 8) | trailer[b];
+    }
+    for (int b = 11; b >= 4; b--) {
+        directory_offset = (directory_offset << 8) | trailer[b];
+    }
+
+    struct ArchivePool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.members = (struct ArchiveMember *)calloc(count ? count : 1, sizeof(struct ArchiveMember));
+    if (pool.members == NULL || fseeko(archive_file, (off_t)directory_offset, SEEK_SET) != 0) {
+        fprintf(stderr, "Error: Corrupt archive '%s'\n", archive_filename);
+        return 1; // Exit with an error code
+    }
+    for (uint32_t m = 0; m < count; m++) {
+        struct ArchiveMember *member = &pool.members[m];
+        uint16_t name_length;
+        if (readUint16(archive_file, &name_length) != 0 || (member->name = (char *)calloc(name_length + 1, 1)) == NULL ||
+            fread(member->name, 1, name_length, archive_file) != name_length || readUint64(archive_file, &member->original_size) != 0 ||
+            readUint64(archive_file, &member->offset) != 0 || readUint64(archive_file, &member->size) != 0) {
+            fprintf(stderr, "Error: Corrupt archive '%s'\n", archive_filename);
+            return 1; // Exit with an error code
+        }
+        pool.count++;
+    }
+    fclose(archive_file);
+
+    pool.archive_filename = archive_filename;
+    pool.directory = directory;
+    pthread_mutex_init(&pool.lock, NULL);
+    mkdir(directory, 0777);
+    if (threads > pool.count) {
+        threads = pool.count > 0 ? pool.count : 1;
+    }
+    struct ArchivePool *jobs[MAX_THREADS];
+    for (int t = 0; t < threads; t++) {
+        jobs[t] = &pool;
+    }
+    runJobs(extractWorker, jobs, sizeof(struct ArchivePool *), threads);
+    pthread_mutex_destroy(&pool.lock);
+
+    for (int m = 0; m < pool.count; m++) {
+        free(pool.members[m].name);
+    }
+    free(pool.members);
+    return pool.failures > 0 ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    char *input_filename = NULL;
+    char *output_filename = NULL;
+    char *table_filename = NULL; // -b: trained table to compress with, -D: trained table to decode with
+    char **batch_filenames = argv + argc; // Files listed after the options of -b or -A
+    int batch_count = 0;
+    char *archive_filename = NULL; // -A: archive to create from the listed files, -X: archive to extract
+    int extract = 0;
+    int decompress = 0; // -d: decode a compressed file
+    int train = 0;      // -T: train a table on the input and save it to the output
+    int batch = 0;
+    struct CompressOptions options = { 0, 1, 0, 0, 0, 0, 0, 0 };
+    int profile = 0; // -P: print phase times and peak memory as JSON on standard error
+    int range = 0; // --range: decode only 'range_length' bytes starting at 'range_start'
+    int threads_given = 0; // -t, which streaming (-s) does not use
+    unsigned long long range_start = 0, range_length = 0;
+
+    // Parse command line arguments
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-i") == 0) {
+            if (i + 1 < argc) {
+                input_filename = argv[i + 1];
+                i++; // Skip the next argument since it's the input filename
+            } else {
+                printf("Error: Missing input filename\n");
+                return 1; // Exit with an error code
+            }
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (i + 1 < argc) {
+                output_filename = argv[i + 1];
+                i++; // Skip the next argument since it's the output filename
+            } else {
+                printf("Error: Missing output filename\n");
+                return 1; // Exit with an error code
+            }
+        } else if (strcmp(argv[i], "-d") == 0) {
+            decompress = 1;
+        } else if (strcmp(argv[i], "--range") == 0) {
+            if (i + 1 < argc && sscanf(argv[i + 1], "%llu:%llu", &range_start, &range_length) == 2) {
+                range = 1;
+                i++; // Skip the next argument since it's the range
+            } else {
+                printf("Error: --range needs start:length\n");
+                return 1; // Exit with an error code
+            }
+        } else if (strcmp(argv[i], "-B") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 1 && atoi(argv[i + 1]) <= (MAX_BLOCK_SIZE >> 10)) {
+                options.block_size = (size_t)atoi(argv[i + 1]) << 10;
+                i++; // Skip the next argument since it's the block size
+            } else {
+                printf("Error: -B needs a block size from 1 to %d KiB\n", MAX_BLOCK_SIZE >> 10);
+                return 1; // Exit with an error code
+            }
+        } else if (strcmp(argv[i], "-A") == 0 || strcmp(argv[i], "-X") == 0) {
+            if (i + 1 < argc) {
+                extract = strcmp(argv[i], "-X") == 0;
+                archive_filename = argv[i + 1];
+                i++; // Skip the next argument since it's the archive filename
+            } else {
+                printf("Error: Missing archive filename\n");
+                return 1; // Exit with an error code
+            }
+        } else if (strcmp(argv[i], "-T") == 0) {
+            train = 1;
+        } else if (strcmp(argv[i], "-b") == 0 || strcmp(argv[i], "-D") == 0) {
+            if (i + 1 < argc) {
+                batch = batch || strcmp(argv[i], "-b") == 0;
+                table_filename = argv[i + 1];
+                i++; // Skip the next argument since it's the table filename
+            } else {
+                printf("Error: Missing table filename\n");
+                return 1; // Exit with an error code
+            }
+        } else if ((batch || (archive_filename != NULL && !extract)) && argv[i][0] != '-') {
+            // Every remaining non-option argument is a file to compress
+            batch_filenames = argv + i;
+            while (i < argc && argv[i][0] != '-') {
+                batch_count++;
+                i++;
+            }
+            i--;
+        } else if (strcmp(argv[i], "-r") == 0) {
+            options.raw = 1; // Write the bare bitstream only (as compared against reference outputs)
+        } else if (strcmp(argv[i], "-s") == 0) {
+            options.stream = 1; // Encode blocks as they arrive, so no second pass over the input is needed
+        } else if (strcmp(argv[i], "-a") == 0) {
+            options.ans = 1; // tANS instead of Huffman codes, for a better ratio on skewed data
+        } else if (strcmp(argv[i], "-P") == 0) {
+            profile = 1;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            options.order1 = 1; // Order-1 tables: the code of a character depends on the character before it
+        } else if (strcmp(argv[i], "-x") == 0) {
+            options.interleave = 1; // Four interleaved sub-streams per block for faster decoding
+        } else if (strcmp(argv[i], "-L") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 8 && atoi(argv[i + 1]) <= MAX_LIMITED_LENGTH) {
+                options.max_length = atoi(argv[i + 1]);
+                i++; // Skip the next argument since it's the length limit
+            } else {
+                printf("Error: -L needs a maximum code length from 8 to %d\n", MAX_LIMITED_LENGTH);
+                return 1; // Exit with an error code
+            }
+        } else if (strcmp(argv[i], "-t") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 1 && atoi(argv[i + 1]) <= MAX_THREADS) {
+                options.threads = atoi(argv[i + 1]);
+                threads_given = 1;
+                i++; // Skip the next argument since it's the thread count
+            } else {
+                printf("Error: -t needs a thread count from 1 to %d\n", MAX_THREADS);
+                return 1; // Exit with an error code
+            }
+        } else {
+            printf("Error: Invalid argument '%s'\n", argv[i]);
+            return 1; // Exit with an error code
+        }
+    }
+
+    if (options.block_size == 0) {
+        options.block_size = options.stream ? STREAM_BLOCK_SIZE : BLOCK_SIZE;
+    }
+
+    // Check if the required command line arguments are provided: an input and an output file, and no
+    // batch or archive options left over from the modes above
+    int invalid_options = input_filename == NULL || output_filename == NULL || batch || archive_filename != NULL ||
+                          (range && !decompress);
+    // Options that do not go together
+    invalid_options = invalid_options || (options.ans && (options.interleave || options.max_length || train)) ||
+                      (options.order1 && (options.ans || options.interleave || options.stream || train)) ||
+                      ((decompress || options.ans || options.order1 || options.stream || options.interleave || train) && options.raw) ||
+                      (options.stream && threads_given);
+
+    // Every phase is timed from here, -P prints the totals when the run is done
+    struct timespec started;
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    phase_mark = started;
+    int status;
+    const char *mode = "compress";
+    if (batch && !decompress && batch_count > 0 && !options.ans && !options.order1) {
+        status = compressBatch(table_filename, batch_filenames, batch_count, &options);
+        mode = "batch";
+    } else if (archive_filename != NULL && !extract && batch_count > 0 && !batch && !options.ans && !options.order1 &&
+               !options.stream && !options.raw) {
+        status = createArchive(archive_filename, batch_filenames, batch_count, &options);
+        mode = "archive";
+    } else if (archive_filename != NULL && extract && input_filename == NULL) {
+        status = extractArchive(archive_filename, output_filename != NULL ? output_filename : ".", options.threads);
+        mode = "extract";
+    } else if (invalid_options) {
+        printf("Usage: %s [-r] [-t threads] [-L max_code_length] [-x] [-B block_KiB] -i input_filename -o output_filename\n", argv[0]);
+        printf("       %s -s [-L max_code_length] [-x] [-B block_KiB] -i input_filename -o output_filename (streaming, one tree per block)\n", argv[0]);
+        printf("       %s -a [-s | -t threads] [-B block_KiB] -i input_filename -o output_filename (tANS instead of Huffman codes)\n", argv[0]);
+        printf("       %s -c [-t threads] [-L max_code_length] [-B block_KiB] -i input_filename -o output_filename (order-1 tables)\n", argv[0]);
+        printf("       %s -d [-D table_filename] [--range start:length] -i compressed_filename -o output_filename\n", argv[0]);
+        printf("       %s -T [-L max_code_length] -i corpus_filename -o table_filename (train a static table)\n", argv[0]);
+        printf("       %s -b table_filename [-x] [-B block_KiB] filename... (compress each file to filename.huf)\n", argv[0]);
+        printf("       %s -A archive_filename [-t threads] [-L max_code_length] [-x] [-B block_KiB] file_or_directory... (one member per file)\n", argv[0]);
+        printf("       %s -X archive_filename [-t threads] [-o directory] (extract every member)\n", argv[0]);
+        printf("Add -P to print phase times and peak memory as JSON on standard error\n");
+        printf("A filename of - reads standard input or writes standard output\n");
+        return 1; // Exit with an error code
+    } else if (decompress) {
+        status = range ? decompressRange(input_filename, output_filename, table_filename, range_start, range_length)
+                       : decompressFile(input_filename, output_filename, table_filename);
+        mode = "decompress";
+    } else if (train) {
+        status = trainTable(input_filename, output_filename, &options);
+        mode = "train";
+    } else if (options.stream) {
+        status = compressStream(input_filename, output_filename, &options);
+    } else {
+        status = compressFile(input_filename, output_filename, &options);
+    }
+
+    if (profile) {
+        struct timespec finished;
+        clock_gettime(CLOCK_MONOTONIC, &finished);
+        printProfile(mode, (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9);
+    }
+    return status;
 }
+#endif
@@ -0,0 +1,164 @@
+#!/bin/bash
+# Benchmark of HuffmanEncoding: compresses and decompresses each data set RUNS times per mode and
+# prints the best run of each as JSON (MB/s, ratio, peak RSS and the phase times reported by -P).
+#
+#   ./bench.sh > bench.json                              run the suite
+#   BASELINE=bench.json ./bench.sh > new.json            also fail (exit 1) on a regression against an earlier run
+#   make bench [BASELINE=bench.json]                     the same, keeping the last passing run in bench.json
+#
+# Settings (environment): RUNS (default 5), CORPUS (text corpus, default completeshakespeare.txt,
+# decoded from the proj2 part files when missing), SIZE (bytes of random and skewed data,
+# default 8 MiB), SMALL_FILES (default 256 files of 4 KiB), TOLERANCE (percent, default 10).
+
+RUNS=${RUNS:-5}
+SIZE=${SIZE:-8388608}
+SMALL_FILES=${SMALL_FILES:-256}
+TOLERANCE=${TOLERANCE:-10}
+PROGRAM=./HuffmanEncoding
+WORK=bench.d
+
+cd "$(dirname "$0")" || exit 1
+make -s Compile >/dev/null || exit 1
+mkdir -p $WORK || exit 1
+
+# The text corpus: completeShakespeare.txt is stored in proj2 as Hamming(7,4) part files, decoded
+# with proj2's diar
+if [ -z "$CORPUS" ]; then
+    CORPUS=completeshakespeare.txt
+    if [ ! -f $CORPUS ]; then
+        CORPUS=$WORK/completeshakespeare.txt
+    fi
+fi
+if [ ! -f "$CORPUS" ]; then
+    PARTS=../proj2/completeShakespeare.txt
+    echo "Reassembling $CORPUS from $PARTS.part0-6" >&2
+    make -s -C ../proj2 diar >/dev/null && ../proj2/diar -f $PARTS >&2 && mv $PARTS.2 "$CORPUS" || exit 1
+fi
+
+# Random data does not compress; skewed data maps random bytes onto 9 characters with halving
+# frequencies (a: 1/2, b: 1/4, ... h and i: 1/256)
+if [ ! -f $WORK/random.bin ]; then
+    head -c "$SIZE" /dev/urandom > $WORK/random.bin
+    SKEW=$(awk 'BEGIN { n = 128; split("a b c d e f g h", c, " "); for (i = 1; i <= 8; i++) { for (j = 0; j < n; j++) printf "%s", c[i]; n /= 2 } printf "i" }')
+    head -c "$SIZE" /dev/urandom | LC_ALL=C tr '\000-\377' "$SKEW" > $WORK/skewed.txt
+fi
+rm -rf $WORK/small && mkdir $WORK/small && head -c $((SMALL_FILES * 4096)) "$CORPUS" | split -b 4096 -a 4 - $WORK/small/f
+
+# Function to pull one field out of a -P profile line
+field() {
+    sed -n "s/.*\"$1\": \([0-9.]*\).*/\1/p" <<< "$2"
+}
+
+# Function to run a command RUNS times and keep the -P profile line of the fastest run in $best
+bestRun() {
+    best=""
+    for ((run = 0; run < RUNS; run++)); do
+        profile=$("$@" 2>&1 >/dev/null | grep '^{"mode"' | tail -n 1)
+        if [ -z "$profile" ]; then
+            echo "Failed: $*" >&2
+            exit 1
+        fi
+        if [ -z "$best" ] || awk -v a="$(field seconds "$profile")" -v b="$(field seconds "$best")" 'BEGIN { exit !(a < b) }'; then
+            best=$profile
+        fi
+    done
+}
+
+# Function to benchmark one data set with one set of options, printing one JSON result line
+benchFile() {
+    local name=$1 input=$2
+    shift 2
+    bestRun $PROGRAM -P "$@" -i "$input" -o $WORK/out.huf
+    compress=$best
+    bestRun $PROGRAM -P -d -i $WORK/out.huf -o $WORK/out.2
+    decompress=$best
+    cmp -s "$input" $WORK/out.2 || { echo "Round trip failed: $name" >&2; exit 1; }
+    result "$name" "$(stat -c %s "$input")" "$(stat -c %s $WORK/out.huf)" "$compress" "$decompress"
+}
+
+# Function to benchmark batch compression (-b) of many small files with a table trained on the corpus
+benchSmallFiles() {
+    $PROGRAM -T -i "$CORPUS" -o $WORK/small.table >/dev/null || exit 1
+    bestRun $PROGRAM -P -b $WORK/small.table $WORK/small/f????
+    compress=$best
+    # Every file is its own decoder process, the profile lines are summed over the files
+    decompress=$(for ((run = 0; run < RUNS; run++)); do
+        for f in $WORK/small/f????; do
+            $PROGRAM -P -d -D $WORK/small.table -i $f.huf -o $f.2 2>&1 >/dev/null | grep '^{"mode"'
+        done | awk '
+            function get(line, key) { return match(line, "\"" key "\": [0-9.]+") ? substr(line, RSTART + length(key) + 4, RLENGTH - length(key) - 4) + 0 : 0 }
+            BEGIN { n = split("seconds read histogram tree codes encode decode write", names, " ") }
+            {
+                for (i = 1; i <= n; i++) value[names[i]] += get($0, names[i])
+                if (get($0, "peak_rss_kb") > rss) rss = get($0, "peak_rss_kb")
+            }
+            END {
+                printf "{\"mode\": \"decompress\", \"seconds\": %.6f, \"peak_rss_kb\": %d, \"phases\": {", value["seconds"], rss
+                for (i = 2; i <= n; i++) printf "%s\"%s\": %.6f", (i > 2 ? ", " : ""), names[i], value[names[i]]
+                printf "}}\n"
+            }'
+    done | sort -t: -k3 -n | head -n 1)
+    for f in $WORK/small/f????; do
+        cmp -s $f $f.2 || { echo "Round trip failed: $f" >&2; exit 1; }
+    done
+    result small-files/batch "$(cat $WORK/small/f???? | wc -c)" "$(cat $WORK/small/*.huf | wc -c)" "$compress" "$decompress"
+}
+
+# Function to print one result as a JSON object on a single line
+result() {
+    awk -v name="$1" -v bytes="$2" -v compressed="$3" -v c="$(field seconds "$4")" -v d="$(field seconds "$5")" \
+        -v c_rss="$(field peak_rss_kb "$4")" -v d_rss="$(field peak_rss_kb "$5")" \
+        -v c_phases="$(sed 's/.*"phases": \({[^}]*}\).*/\1/' <<< "$4")" -v d_phases="$(sed 's/.*"phases": \({[^}]*}\).*/\1/' <<< "$5")" 'BEGIN {
+        printf "    {\"name\": \"%s\", \"bytes\": %d, \"compressed_bytes\": %d, \"ratio\": %.4f, ", name, bytes, compressed, compressed / bytes
+        printf "\"compress_mb_s\": %.1f, \"decompress_mb_s\": %.1f, ", bytes / c / 1e6, bytes / d / 1e6
+        printf "\"compress_peak_rss_kb\": %d, \"decompress_peak_rss_kb\": %d, ", c_rss, d_rss
+        printf "\"compress_phases\": %s, \"decompress_phases\": %s}", c_phases, d_phases
+    }'
+}
+
+{
+    echo "{"
+    echo "  \"runs\": $RUNS,"
+    echo "  \"corpus\": \"$CORPUS\","
+    echo "  \"results\": ["
+    for data in shakespeare:"$CORPUS" random:$WORK/random.bin skewed:$WORK/skewed.txt; do
+        name=${data%%:*} input=${data#*:}
+        benchFile $name/huffman "$input"
+        echo ","
+        benchFile $name/interleaved "$input" -x
+        echo ","
+        benchFile $name/tans "$input" -a
+        echo ","
+        benchFile $name/order1 "$input" -c
+        echo ","
+    done
+    benchSmallFiles
+    echo
+    echo "  ]"
+    echo "}"
+} > $WORK/bench.json || exit 1
+cat $WORK/bench.json
+
+# Regression check: any result whose throughput dropped more than TOLERANCE percent, or whose
+# ratio grew by more than 0.1 percentage points, against the baseline fails the run
+if [ -n "$BASELINE" ]; then
+    awk -v tolerance="$TOLERANCE" '
+        function get(line, key) { return match(line, "\"" key "\": [0-9.]+") ? substr(line, RSTART + length(key) + 4, RLENGTH - length(key) - 4) + 0 : -1 }
+        function name(line) { return match(line, /"name": "[^"]*"/) ? substr(line, RSTART + 9, RLENGTH - 10) : "" }
+        FNR == NR { if (name($0) != "") { base[name($0)] = $0 } next }
+        name($0) in base {
+            n = name($0); old = base[n]
+            split("compress_mb_s decompress_mb_s", keys, " ")
+            for (k = 1; k <= 2; k++) {
+                if (get($0, keys[k]) < get(old, keys[k]) * (1 - tolerance / 100)) {
+                    printf "Regression: %s %s %.1f -> %.1f\n", n, keys[k], get(old, keys[k]), get($0, keys[k]) > "/dev/stderr"
+                    failed = 1
+                }
+            }
+            if (get($0, "ratio") > get(old, "ratio") + 0.001) {
+                printf "Regression: %s ratio %.4f -> %.4f\n", n, get(old, "ratio"), get($0, "ratio") > "/dev/stderr"
+                failed = 1
+            }
+        }
+        END { exit failed }' "$BASELINE" $WORK/bench.json || exit 1
+fi
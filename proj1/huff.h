@@ -0,0 +1,49 @@
+#ifndef HUFF_H
+#define HUFF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Library API of HuffmanEncoding.c (make Library builds HuffmanEncoding.o with -DHUFF_NO_MAIN, which
+// leaves out main and the code only it uses; everything else in the object is static):
+//   huff_build(ctx, counts, max_length)   codes for a histogram, max_length 0 for unlimited Huffman codes
+//   huff_use_lengths(ctx, lengths)        codes from stored code lengths, for the decoding side
+//   huff_encode / huff_decode             code a record with the codes of the context
+//   huff_compress / huff_decompress       self-contained records that carry their own code lengths
+// A context is a plain struct (stack, static or embedded); none of these calls allocates memory.
+
+#define HUFF_CHARACTERS 256 // Characters of a histogram, indexed by byte value
+#define HUFF_NODES (2 * HUFF_CHARACTERS - 1) // Nodes of a tree over every character: the size of the huff_ctx arena
+#define HUFF_MAX_LENGTH 48 // Longest huff_ctx code; two-queue trees of less than 2^32 characters stay below it
+#define HUFF_FAST_BITS 10 // Input bits resolved by one probe of the huff_ctx decode table
+
+// Struct to store a Huffman code as an integer (bits, length) pair
+struct BitCode {
+    uint64_t bits; // Code bits, right aligned, first bit of the code is the most significant
+    int length;    // Number of code bits (0 if the character has no code)
+};
+
+// Struct for a reusable coder context (see huff_build): the tree is built in a fixed arena and every
+// table has a fixed size, so building codes and coding records never touches the heap
+struct huff_ctx {
+    uint64_t weights[HUFF_NODES]; // Leaves in ascending weight order, then the internal nodes in the order they are made
+    int16_t parents[HUFF_NODES];  // Parent of each node, then the depth of each node once the tree is complete
+    uint8_t leaves[HUFF_CHARACTERS]; // Character of each leaf
+    unsigned char lengths[HUFF_CHARACTERS];
+    struct BitCode codes[HUFF_CHARACTERS];
+    uint16_t fast[1 << HUFF_FAST_BITS];  // Code length (high 8 bits) and character by the next HUFF_FAST_BITS bits, 0 for longer codes
+    uint64_t first[HUFF_MAX_LENGTH + 1]; // First canonical code of each length
+    uint16_t length_counts[HUFF_MAX_LENGTH + 1];
+    uint16_t offsets[HUFF_MAX_LENGTH + 1]; // Index of the first character of each length in 'sorted'
+    uint8_t sorted[HUFF_CHARACTERS];       // Characters in canonical order
+    int max_length;                        // Longest code in the tables, 0 if no character has a code
+};
+
+int huff_use_lengths(struct huff_ctx *ctx, const unsigned char *lengths);
+int huff_build(struct huff_ctx *ctx, const uint64_t *counts, int max_length);
+size_t huff_encode(const struct huff_ctx *ctx, const unsigned char *data, size_t size, unsigned char *output, size_t capacity);
+int huff_decode(const struct huff_ctx *ctx, const unsigned char *input, size_t input_size, unsigned char *output, size_t size);
+size_t huff_compress(struct huff_ctx *ctx, const unsigned char *data, size_t size, unsigned char *output, size_t capacity);
+int64_t huff_decompress(struct huff_ctx *ctx, const unsigned char *input, size_t input_size, unsigned char *output, size_t capacity);
+
+#endif
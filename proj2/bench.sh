@@ -0,0 +1,118 @@
+#!/bin/bash
+# Benchmark of raid and diar: encodes completeShakespeare.txt with every code, decodes it, and rebuilds
+# as many lost parts as the code can restore, RUNS times each, and prints the best run of each as JSON
+# (MB/s of the input, and the storage overhead of the parts). The hex text parts of Hamming(7,4) (-t) are
+# only encoded and decoded, they cannot be rebuilt.
+#
+#   ./bench.sh > bench.json          run the suite
+#   make bench                       the same, keeping the last run in bench.json
+#
+# Settings (environment): RUNS (default 5), CORPUS (input, default completeShakespeare.txt, decoded from
+# the part files in this directory when missing).
+
+RUNS=${RUNS:-5}
+WORK=bench.d
+
+cd "$(dirname "$0")" || exit 1
+make -s raid diar >/dev/null || exit 1
+mkdir -p $WORK || exit 1
+
+# The corpus is stored here as the headerless Hamming(7,4) parts completeShakespeare.txt.part0-6
+if [ -z "$CORPUS" ]; then
+    CORPUS=$WORK/completeShakespeare.txt
+    if [ ! -f $CORPUS ]; then
+        echo "Reassembling $CORPUS from completeShakespeare.txt.part0-6" >&2
+        ./diar -f completeShakespeare.txt >&2 && mv completeShakespeare.txt.2 $CORPUS || exit 1
+    fi
+else
+    cp "$CORPUS" $WORK/corpus || exit 1
+    CORPUS=$WORK/corpus
+fi
+BYTES=$(stat -c %s $CORPUS)
+
+# Function to run a command RUNS times and keep the time of the fastest run in $best (seconds)
+bestTime() {
+    local run start end
+    best=""
+    for ((run = 0; run < RUNS; run++)); do
+        start=$(date +%s.%N)
+        "$@" >/dev/null 2>&1 || { echo "Failed: $*" >&2; exit 1; }
+        end=$(date +%s.%N)
+        best=$(awk -v a="$start" -v b="$end" -v best="$best" 'BEGIN { t = b - a; print (best == "" || t < best) ? t : best }')
+    done
+}
+
+# Function to benchmark one code: encode, decode with every part, and rebuild the parts in $lost from
+# the others, printing one JSON result line
+benchCode() {
+    local name=$1 options=$2 lost=$3 run rebuild=""
+    rm -f $CORPUS.part* $CORPUS.2
+    bestTime ./raid -f $CORPUS $options
+    encode=$best
+    mkdir -p $WORK/parts && cp $CORPUS.part* $WORK/parts/ || exit 1
+    parts=$(ls $CORPUS.part* | wc -l)
+    stored=$(cat $CORPUS.part* | wc -c)
+    bestTime ./diar -f $CORPUS
+    decode=$best
+    cmp -s $CORPUS $CORPUS.2 || { echo "Round trip failed: $name" >&2; exit 1; }
+    # The lost parts are deleted again before every run
+    for ((run = 0; run < RUNS; run++)); do
+        for part in $lost; do
+            rm -f $CORPUS.part$part
+        done
+        RUNS=1 bestTime ./diar -f $CORPUS -r
+        rebuild=$(awk -v a="$best" -v best="$rebuild" 'BEGIN { print (best == "" || a < best) ? a : best }')
+    done
+    for part in $lost; do
+        cmp -s $CORPUS.part$part $WORK/parts/$(basename $CORPUS).part$part || { echo "Rebuild failed: $name part $part" >&2; exit 1; }
+    done
+    rm -rf $WORK/parts
+    awk -v name="$name" -v bytes=$BYTES -v parts=$parts -v stored=$stored -v lost="$lost" -v e=$encode -v d=$decode -v r=$rebuild 'BEGIN {
+        printf "    {\"name\": \"%s\", \"bytes\": %d, \"parts\": %d, \"lost_parts\": %d, \"overhead\": %.4f, ", name, bytes, parts, split(lost, l, " "), stored / bytes - 1
+        printf "\"encode_mb_s\": %.1f, \"decode_mb_s\": %.1f, \"reconstruct_mb_s\": %.1f}", bytes / e / 1e6, bytes / d / 1e6, bytes / r / 1e6
+    }'
+}
+
+# Function to benchmark the hex text parts (raid -t, diar -t), printing one JSON result line
+benchText() {
+    local name=$1
+    rm -f $CORPUS.part* $CORPUS.2
+    bestTime ./raid -f $CORPUS -t
+    encode=$best
+    parts=$(ls $CORPUS.part* | wc -l)
+    stored=$(cat $CORPUS.part* | wc -c)
+    bestTime ./diar -f $CORPUS -t -s $BYTES
+    decode=$best
+    cmp -s $CORPUS $CORPUS.2 || { echo "Round trip failed: $name" >&2; exit 1; }
+    awk -v name="$name" -v bytes=$BYTES -v parts=$parts -v stored=$stored -v e=$encode -v d=$decode 'BEGIN {
+        printf "    {\"name\": \"%s\", \"bytes\": %d, \"parts\": %d, \"lost_parts\": 0, \"overhead\": %.4f, ", name, bytes, parts, stored / bytes - 1
+        printf "\"encode_mb_s\": %.1f, \"decode_mb_s\": %.1f}", bytes / e / 1e6, bytes / d / 1e6
+    }'
+}
+
+{
+    echo "{"
+    echo "  \"runs\": $RUNS,"
+    echo "  \"corpus\": \"$CORPUS\","
+    echo "  \"results\": ["
+    benchCode hamming74 "-c 74" "0 1"
+    echo ","
+    benchText hamming74/text
+    echo ","
+    benchCode hamming1511 "-c 1511" "0 1"
+    echo ","
+    benchCode secded7264/24 "-c 7264 -n 24" "0"
+    echo ","
+    benchCode secded7264/72 "-c 7264 -n 72" "0 1 2"
+    echo ","
+    benchCode reed-solomon/4+2 "-c rs -k 4 -m 2" "0 1"
+    echo ","
+    benchCode reed-solomon/8+2 "-c rs -k 8 -m 2" "0 1"
+    echo ","
+    benchCode reed-solomon/10+4 "-c rs -k 10 -m 4" "0 1 2 3"
+    echo
+    echo "  ]"
+    echo "}"
+} > $WORK/bench.json || exit 1
+rm -f $CORPUS.part* $CORPUS.2
+cat $WORK/bench.json
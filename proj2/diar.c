@@ -1,178 +1,1175 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "stripe.h"
+#include "lanecode.h"
+#include "reedsolomon.h"
 
-// Function to convert a hexadecimal character to binary
-void hexToBinary(char hex, char* binary) {
-    switch (hex) {
-        case '0':
-            strcpy(binary, "0000");
-            break;
-        case '1':
-            strcpy(binary, "0001");
-            break;
-        case '2':
-            strcpy(binary, "0010");
-            break;
-        case '3':
-            strcpy(binary, "0011");
-            break;
-        case '4':
-            strcpy(binary, "0100");
-            break;
-        case '5':
-            strcpy(binary, "0101");
-            break;
-        case '6':
-            strcpy(binary, "0110");
-            break;
-        case '7':
-            strcpy(binary, "0111");
-            break;
-        case '8':
-            strcpy(binary, "1000");
-            break;
-        case '9':
-            strcpy(binary, "1001");
-            break;
-        case 'A':
-        case 'a':
-            strcpy(binary, "1010");
-            break;
-        case 'B':
-        case 'b':
-            strcpy(binary, "1011");
-            break;
-        case 'C':
-        case 'c':
-            strcpy(binary, "1100");
-            break;
-        case 'D':
-        case 'd':
-            strcpy(binary, "1101");
-            break;
-        case 'E':
-        case 'e':
-            strcpy(binary, "1110");
-            break;
-        case 'F':
-        case 'f':
-            strcpy(binary, "1111");
-            break;
-        default:
-            strcpy(binary, "0000"); // Set to 0000 for non-hex characters
-    }
-}
-
-// Function to convert a 4-bit binary to hexadecimal character
-char binaryToHex(char* binary) {
-    int decimal = 0;
-    for (int i = 0; i < 4; i++) {
-        decimal = decimal * 2 + (binary[i] - '0');
-    }
-    return "0123456789ABCDEF"[decimal];
-}
-
-// Function to decode Hamming(7,4) code from binary representation
-void decodeHamming74(const char* binaryData, char* decodedData) {
-    char dataBits[4];
-    int parityBits[3];
-    
-    // Extract data and parity bits from the binary representation
-    dataBits[0] = binaryData[2]; // D1
-    dataBits[1] = binaryData[3]; // D2
-    dataBits[2] = binaryData[4]; // D3
-    dataBits[3] = binaryData[5]; // D4
-    
-    parityBits[0] = binaryData[0]; // P1
-    parityBits[1] = binaryData[1]; // P2
-    parityBits[2] = binaryData[6]; // P3
-    
-    // Calculate the syndrome to check for errors
-    int syndrome = (parityBits[0] << 2) | (parityBits[1] << 1) | parityBits[2];
-    
-    // Check if there is an error
-    if (syndrome != 0) {
-        // There is an error, try to correct it
-        int errorPosition = syndrome - 1;
-        
-        // Correct the bit at the error position
-        dataBits[errorPosition] = (dataBits[errorPosition] == '0') ? '1' : '0';
-    }
-    
-    // Reconstruct the original 4 data bits
-    decodedData[0] = dataBits[0];
-    decodedData[1] = dataBits[1];
-    decodedData[2] = dataBits[2];
-    decodedData[3] = dataBits[3];
-    decodedData[4] = '\0';
+#define PARTS 7 // Part files, one per bit of a Hamming(7,4) codeword
+#define PART_BLOCK_SIZE (256 << 10) // Bytes read from every part per block of parts without a header
+#define MAX_THREADS 256 // Upper limit for -j
+#define INPUT_BUFFER_SIZE (1 << 20) // Bytes buffered per hex text part file between reads (-t)
+
+// Part files are read as raid.c writes them: a stripe header (stripe.h), then bit i of part k is codeword
+// bit k of the i-th nibble, most significant bit first, codeword bits P1, P2, D1, P4, D2, D3, D4, then a
+// CRC-32 of every block. Parts without a header (the first packed format) are still read, without checks.
+// Any 2 missing parts, and 28 of the 35 sets of 3, leave enough parts to decode and rebuild (-r) the
+// others. Scrubbing (-S, -R) checks and repairs the parts in place. Hex text parts (raid.c -t) are the same
+// bytes as parts without a header, two digits per byte; -t turns them back into bytes and decodes them
+// through the same tables.
+// Parts whose header names a lane code (raid.c -c 1511 or -c 7264) are decoded 64 codewords per word
+// (lanecode.h): part blocks that fail their checksum or parts that are missing are erased lanes, which
+// the checks restore as long as their columns are independent (any 2 lanes of Hamming(15,11), any 3 of
+// SECDED(72,64)). Reed-Solomon parts (raid.c -c rs) restore any m erased parts from the other k.
+
+// Decoded nibble of every 7-bit codeword (codeword bit k in bit 6 - k) after correcting a single bit
+// error, with bit 4 set if a bit was corrected and bit 5 if an error was found but not corrected
+unsigned char decodeTable[128];
+
+// Hamming(7,4) codeword of every nibble, and the part bits of both nibbles of a byte (byte k of the
+// entry, as in raid.c) for rebuilding missing parts
+unsigned char hammingCodewords[16];
+uint64_t partPairs[256];
+
+// Codeword bits of the 8 codewords in one byte of part k: codeword j is byte j of the result
+uint64_t partSpread[PARTS][256];
+
+// What decodeParts does with the decoded blocks
+enum DecodeMode {
+    DECODE_FILE,   // Write the decoded file
+    REBUILD_PARTS, // Encode the missing parts again (-r)
+    SCRUB_PARTS,   // Only report the blocks that have errors (-S)
+    REPAIR_PARTS   // As SCRUB_PARTS, and write corrected part blocks back in place (-R)
+};
+
+// Struct for the decode tables of one set of usable parts
+struct DecodeTables {
+    int present;                  // Usable parts, part k in bit 6 - k (0 until the tables are built)
+    unsigned char codewords[128]; // Decoded nibble of every codeword, flags as in decodeTable
+    uint16_t pairs[1 << 14];      // Decoded byte of every pair of codewords (the high nibble's in the low 7
+                                  // bits), corrected codewords in bits 8-9 and uncorrectable ones in bits 10-11
+};
+
+// Struct for the part files of a stripe set and the layout of their data
+struct StripeSet {
+    int parts;                    // Part files of the set
+    int fds[STRIPE_MAX_PARTS];    // -1 for a missing part
+    int present;                  // Hamming(7,4) parts that are open, part k in bit 6 - k
+    int openParts;                // Parts that are open, of any code
+    char missing[3 * STRIPE_MAX_PARTS + 1]; // Numbers of the missing parts, for messages
+    struct LaneCode lanes;        // The lane code of the set, no lanes for Hamming(7,4)
+    struct ReedSolomon rs;        // The Reed-Solomon code of the set, no data parts for the others
+    int lanesPerPart;             // 1 for Reed-Solomon
+    int headers;                  // 1 if the parts have a stripe header
+    struct StripeHeader header;   // Header of the parts
+    uint64_t dataOffset;          // Bytes before the data of a part
+    uint64_t partBytes;           // Data bytes of every part
+    uint64_t outputBytes;         // Bytes of the decoded file
+    size_t blockPartBytes;        // Data bytes of a part in one block
+    size_t blockOutputBytes;      // Decoded bytes of one block
+    uint64_t blockCount;
+    uint32_t *checksums[STRIPE_MAX_PARTS]; // CRC-32 of every block of every open part (NULL without headers)
+};
+
+// Struct shared by the threads that decode the blocks of a stripe set
+struct DecodePool {
+    const struct StripeSet *set;
+    struct DecodeTables tables;   // For the parts that are present
+    enum DecodeMode mode;
+    int outputFd;
+    int rebuiltFds[STRIPE_MAX_PARTS]; // -1 for every part that is not rebuilt
+    uint32_t *rebuiltChecksums[STRIPE_MAX_PARTS];
+    uint64_t blockCount;          // Blocks to decode
+    uint64_t next;                // Next block to take
+    int failed;
+    double rate;                  // Part bytes read per second at most (-m), 0 for no limit
+    double start;                 // Monotonic clock time of the first block
+    pthread_mutex_t lock;         // Protects next and failed
+};
+
+// Struct for one decoding thread: its buffers, tables for blocks that fail a checksum, and its counts
+struct DecodeWorker {
+    struct DecodePool *pool;
+    struct DecodeTables tables;
+    unsigned char *parts[STRIPE_MAX_PARTS];
+    unsigned char *output;
+    uint64_t *checks[LANE_MAX_ROWS]; // Check words of a strip of lanes (lane codes only)
+    struct ReedSolomonErasures rsErasures; // Solution for the last erasures (Reed-Solomon only)
+    unsigned long long corrected, uncorrectable, checksumFailures, damagedBlocks;
+    unsigned long long badBlocks, repairedBlocks; // Scrubbing: blocks with errors, and those written back
+};
+
+// Function to fill the decode table: the syndrome of a codeword is the position (1 to 7) of the
+// flipped bit in P1 P2 D1 P4 D2 D3 D4 order, 0 for a valid codeword
+void buildDecodeTables(void) {
+    for (int codeword = 0; codeword < 128; codeword++) {
+        int bits[PARTS];
+        for (int k = 0; k < PARTS; k++) {
+            bits[k] = (codeword >> (6 - k)) & 1;
+        }
+        int syndrome = (bits[0] ^ bits[2] ^ bits[4] ^ bits[6]) |       // P1 covers positions 1, 3, 5, 7
+                       (bits[1] ^ bits[2] ^ bits[5] ^ bits[6]) << 1 |  // P2 covers positions 2, 3, 6, 7
+                       (bits[3] ^ bits[4] ^ bits[5] ^ bits[6]) << 2;   // P4 covers positions 4, 5, 6, 7
+        if (syndrome != 0) {
+            bits[syndrome - 1] ^= 1;
+        }
+        decodeTable[codeword] = (unsigned char)(bits[2] << 3 | bits[4] << 2 | bits[5] << 1 | bits[6] | (syndrome != 0) << 4);
+    }
+    for (int nibble = 0; nibble < 16; nibble++) {
+        int d1 = (nibble >> 3) & 1, d2 = (nibble >> 2) & 1, d3 = (nibble >> 1) & 1, d4 = nibble & 1;
+        int bits[PARTS] = { d1 ^ d2 ^ d4, d1 ^ d3 ^ d4, d1, d2 ^ d3 ^ d4, d2, d3, d4 };
+        hammingCodewords[nibble] = 0;
+        for (int k = 0; k < PARTS; k++) {
+            hammingCodewords[nibble] |= bits[k] << (6 - k);
+        }
+    }
+    for (int k = 0; k < PARTS; k++) {
+        for (int byte = 0; byte < 256; byte++) {
+            partSpread[k][byte] = 0;
+            for (int j = 0; j < 8; j++) {
+                partSpread[k][byte] |= (uint64_t)((byte >> (7 - j)) & 1) << (8 * j + 6 - k);
+            }
+        }
+    }
+    for (int byte = 0; byte < 256; byte++) {
+        partPairs[byte] = 0;
+        for (int k = 0; k < PARTS; k++) {
+            uint64_t high = (hammingCodewords[byte >> 4] >> (6 - k)) & 1;
+            uint64_t low = (hammingCodewords[byte & 15] >> (6 - k)) & 1;
+            partPairs[byte] |= (high << 1 | low) << (8 * k);
+        }
+    }
 }
 
-int main(int argc, char *argv[]) {
-    if (argc != 5 || strcmp(argv[1], "-f") != 0 || strcmp(argv[3], "-s") != 0) {
-        printf("Usage: %s -f <filename> -s <number of bytes>\n", argv[0]);
+// Function to fill the decode tables for a stripe set with missing parts: the bits of the missing parts
+// are ignored, and each codeword decodes to the nibble whose codeword is nearest on the parts that are
+// present. With every part present this is the syndrome table. Returns -1 if two nibbles agree on every
+// present part, so the parts cannot tell them apart
+int buildErasureTable(struct DecodeTables *tables, int present) {
+    for (int a = 0; a < 16; a++) {
+        for (int b = a + 1; b < 16; b++) {
+            if (((hammingCodewords[a] ^ hammingCodewords[b]) & present) == 0) {
+                return -1;
+            }
+        }
+    }
+    for (int codeword = 0; codeword < 128 && present != 0x7F; codeword++) {
+        int best = 0, bestDistance = PARTS + 1, ties = 0;
+        for (int nibble = 0; nibble < 16; nibble++) {
+            int distance = __builtin_popcount((hammingCodewords[nibble] ^ codeword) & present);
+            if (distance < bestDistance) {
+                best = nibble;
+                bestDistance = distance;
+                ties = 0;
+            } else if (distance == bestDistance) {
+                ties++;
+            }
+        }
+        // An error next to an erasure leaves two nearest nibbles: it is detected but cannot be corrected
+        tables->codewords[codeword] = (unsigned char)(best | (bestDistance > 0 && ties == 0) << 4 | (ties > 0) << 5);
+    }
+    if (present == 0x7F) {
+        memcpy(tables->codewords, decodeTable, sizeof(decodeTable));
+    }
+    tables->present = present;
+    return 0;
+}
+
+// Function to combine the decode table into the table of codeword pairs
+void buildPairTable(struct DecodeTables *tables) {
+    for (int pair = 0; pair < (1 << 14); pair++) {
+        unsigned char high = tables->codewords[pair & 0x7F], low = tables->codewords[pair >> 7];
+        int corrected = ((high >> 4) & 1) + ((low >> 4) & 1);
+        int uncorrectable = (high >> 5) + (low >> 5);
+        tables->pairs[pair] = (uint16_t)((high & 15) << 4 | (low & 15) | corrected << 8 | uncorrectable << 10);
+    }
+}
+
+// Function to check a part header against this decoder and against the size of its file
+int checkStripeHeader(const struct StripeHeader *header, int part, uint64_t fileSize) {
+    struct LaneCode lanes;
+    uint64_t partBytes;
+    if (header->version != STRIPE_VERSION || header->part != part || header->block_size == 0) {
+        return -1;
+    }
+    if (header->code == STRIPE_CODE_HAMMING74) {
+        if (header->parts != PARTS || header->block_size % 4 != 0) {
+            return -1;
+        }
+        partBytes = (header->original_size + 3) / 4;
+    } else if (setupLaneCode(&lanes, header->code) == 0) {
+        if (header->parts == 0 || lanes.lanes % header->parts != 0 || header->block_size % (8 * lanes.dataLanes) != 0) {
+            return -1;
+        }
+        partBytes = lanes.lanes / header->parts * stripeLaneBytes(header->original_size, header->block_size, lanes.dataLanes);
+    } else if (isReedSolomon(header->code)) {
+        int dataParts = header->parts - (header->code & 0x0F);
+        if ((header->code & 0x0F) == 0 || dataParts < 1 || header->block_size % (8 * dataParts) != 0) {
+            return -1;
+        }
+        partBytes = stripeLaneBytes(header->original_size, header->block_size, dataParts);
+    } else {
+        return -1;
+    }
+    uint64_t blocks = (header->original_size + header->block_size - 1) / header->block_size;
+    if (header->part_bytes != partBytes || header->block_count != blocks ||
+        fileSize != STRIPE_HEADER_SIZE + header->part_bytes + 4 * blocks) {
+        return -1;
+    }
+    return 0;
+}
+
+// Function to open the parts of a stripe set and work out their layout. Parts written by raid.c start
+// with a stripe header; a part whose header is missing, damaged or disagrees with the others is treated
+// as missing. Parts without any header (the first packed format) are decoded up to the shortest part,
+// or 'limit' bytes if it is not 0
+int openStripeSet(const char *filename, struct StripeSet *set, unsigned long long limit, int writable) {
+    struct StripeHeader headers[STRIPE_MAX_PARTS];
+    uint64_t fileSizes[STRIPE_MAX_PARTS];
+    unsigned char magic[STRIPE_MAX_PARTS] = { 0 };
+    int reference = -1;
+    memset(set, 0, sizeof(*set));
+    for (int k = 0; k < STRIPE_MAX_PARTS; k++) {
+        char partFilename[4096];
+        unsigned char bytes[STRIPE_HEADER_SIZE];
+        struct stat info;
+        snprintf(partFilename, sizeof(partFilename), "%s.part%d", filename, k);
+        set->fds[k] = open(partFilename, writable ? O_RDWR : O_RDONLY);
+        if (set->fds[k] < 0 || fstat(set->fds[k], &info) != 0) {
+            continue;
+        }
+        posix_fadvise(set->fds[k], 0, 0, POSIX_FADV_SEQUENTIAL);
+        fileSizes[k] = (uint64_t)info.st_size;
+        headers[k].version = 0;
+        if (readAt(set->fds[k], bytes, STRIPE_HEADER_SIZE, 0) == STRIPE_HEADER_SIZE && parseStripeHeader(bytes, &headers[k]) == 0) {
+            magic[k] = 1;
+            set->headers = 1;
+            if (reference < 0 && checkStripeHeader(&headers[k], k, fileSizes[k]) == 0) {
+                reference = k;
+            }
+        }
+    }
+    if (set->headers && reference < 0) {
+        fprintf(stderr, "Error: no part of %s has a valid stripe header\n", filename);
+        return -1;
+    }
+
+    // Part files past the last part of the set (left over from another code) are not part of it
+    set->parts = set->headers ? headers[reference].parts : PARTS;
+    for (int k = set->parts; k < STRIPE_MAX_PARTS; k++) {
+        if (set->fds[k] >= 0) {
+            close(set->fds[k]);
+            set->fds[k] = -1;
+        }
+    }
+    set->partBytes = UINT64_MAX;
+    for (int k = 0; k < set->parts; k++) {
+        if (set->fds[k] < 0) {
+            snprintf(set->missing + strlen(set->missing), sizeof(set->missing) - strlen(set->missing), " %d", k);
+            continue;
+        }
+        if (set->headers) {
+            const struct StripeHeader *first = &headers[reference];
+            if (!magic[k] || checkStripeHeader(&headers[k], k, fileSizes[k]) != 0 || headers[k].code != first->code ||
+                headers[k].parts != first->parts || headers[k].original_size != first->original_size ||
+                headers[k].block_size != first->block_size) {
+                fprintf(stderr, "Warning: part %d has no valid stripe header, treating it as missing\n", k);
+                close(set->fds[k]);
+                set->fds[k] = -1;
+                snprintf(set->missing + strlen(set->missing), sizeof(set->missing) - strlen(set->missing), " %d", k);
+                continue;
+            }
+        } else if (fileSizes[k] < set->partBytes) {
+            set->partBytes = fileSizes[k];
+        }
+        set->present |= k < PARTS ? 1 << (6 - k) : 0;
+        set->openParts++;
+    }
+    if (set->openParts == 0) {
+        fprintf(stderr, "Error: no part of %s was found\n", filename);
+        return -1;
+    }
+
+    if (set->headers) {
+        set->header = headers[reference];
+        set->dataOffset = STRIPE_HEADER_SIZE;
+        set->partBytes = set->header.part_bytes;
+        set->outputBytes = set->header.original_size;
+        set->blockPartBytes = set->header.block_size / 4;
+        set->blockOutputBytes = set->header.block_size;
+        set->blockCount = set->header.block_count;
+        if (setupLaneCode(&set->lanes, set->header.code) == 0) {
+            set->lanesPerPart = set->lanes.lanes / set->parts;
+            set->blockPartBytes = set->lanesPerPart * (set->header.block_size / set->lanes.dataLanes);
+            set->present = 0;
+        } else if (isReedSolomon(set->header.code)) {
+            setupReedSolomon(&set->rs, set->parts - (set->header.code & 0x0F), set->header.code & 0x0F);
+            set->lanesPerPart = 1;
+            set->blockPartBytes = set->header.block_size / set->rs.dataParts;
+            set->present = 0;
+        }
+        if (limit > 0 && limit != set->outputBytes) {
+            fprintf(stderr, "Warning: -s %llu differs from the %llu bytes recorded in the part headers, using the headers\n",
+                    limit, (unsigned long long)set->outputBytes);
+        }
+        // The checksum table follows the data of every part
+        for (int k = 0; k < set->parts; k++) {
+            if (set->fds[k] < 0) {
+                continue;
+            }
+            size_t tableBytes = 4 * (size_t)set->blockCount;
+            unsigned char *table = (unsigned char *)malloc(tableBytes + 1);
+            set->checksums[k] = (uint32_t *)malloc(sizeof(uint32_t) * (set->blockCount + 1));
+            if (table == NULL || set->checksums[k] == NULL) {
+                printf("Error: Out of memory\n");
+                return -1;
+            }
+            if (readAt(set->fds[k], table, tableBytes, set->dataOffset + set->partBytes) != tableBytes) {
+                perror("Error reading input file");
+                return -1;
+            }
+            for (uint64_t b = 0; b < set->blockCount; b++) {
+                set->checksums[k][b] = (uint32_t)getLittleEndian(table + 4 * b, 4);
+            }
+            free(table);
+        }
+        return 0;
+    }
+
+    for (int k = 0; k < PARTS; k++) {
+        if (set->fds[k] >= 0 && fileSizes[k] > set->partBytes) {
+            fprintf(stderr, "Warning: part %d is longer than the others, its tail was not decoded\n", k);
+        }
+    }
+    set->outputBytes = set->partBytes * 4;
+    if (limit > 0 && limit < set->outputBytes) {
+        set->outputBytes = limit;
+    } else if (limit > set->outputBytes) {
+        fprintf(stderr, "Warning: the parts hold only %llu of %llu bytes\n", (unsigned long long)set->outputBytes, limit);
+    }
+    set->blockPartBytes = PART_BLOCK_SIZE;
+    set->blockOutputBytes = 4 * PART_BLOCK_SIZE;
+    set->blockCount = (set->partBytes + PART_BLOCK_SIZE - 1) / PART_BLOCK_SIZE;
+    return 0;
+}
+
+// Function to read the monotonic clock in seconds
+double monotonicSeconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+// Function to hand out the next block to decode, -1 when there are none left or a thread failed. With a
+// rate limit the block is held back until the bytes read so far fit the rate
+int64_t takeBlock(struct DecodePool *pool) {
+    pthread_mutex_lock(&pool->lock);
+    int64_t block = pool->failed || pool->next >= pool->blockCount ? -1 : (int64_t)pool->next++;
+    if (block >= 0 && pool->rate > 0) {
+        double due = pool->start + (double)block * pool->set->blockPartBytes * pool->set->openParts / pool->rate;
+        double wait = due - monotonicSeconds();
+        if (wait > 0) {
+            struct timespec pause = { (time_t)wait, (long)((wait - (time_t)wait) * 1e9) };
+            while (nanosleep(&pause, &pause) != 0 && errno == EINTR) {
+            }
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return block;
+}
+
+// Function to pick the decode tables for the parts that are usable in one block: the tables of the stripe
+// set, or the worker's own when blocks fail their checksum. Returns NULL if those parts cannot decode
+const struct DecodeTables *usableTables(struct DecodeWorker *worker, int usable) {
+    if (usable == worker->pool->tables.present) {
+        return &worker->pool->tables;
+    }
+    if (usable != worker->tables.present) {
+        if (buildErasureTable(&worker->tables, usable) != 0) {
+            return NULL;
+        }
+        buildPairTable(&worker->tables);
+    }
+    return &worker->tables;
+}
+
+// Function to check a decoded block against the part blocks it came from (-S): the data is encoded
+// again, and a part byte that differs held an error. With REPAIR_PARTS the parts that differ are written
+// back in place, as long as the new part block matches its checksum. 'failed' has a bit set for every
+// part whose block failed its checksum, 'uncorrectable' is the count of codewords that could not be decoded
+int scrubBlock(struct DecodeWorker *worker, uint64_t block, size_t count, int failed, unsigned long long corrected,
+               unsigned long long uncorrectable) {
+    struct DecodePool *pool = worker->pool;
+    const struct StripeSet *set = pool->set;
+    const unsigned char *output = worker->output;
+    size_t differences[PARTS] = { 0 };
+    for (size_t i = 0; i < count; i++) {
+        const unsigned char *in = output + 4 * i;
+        uint64_t bytes = partPairs[in[0]] << 6 | partPairs[in[1]] << 4 | partPairs[in[2]] << 2 | partPairs[in[3]];
+        for (int k = 0; k < PARTS; k++) {
+            unsigned char byte = (unsigned char)(bytes >> (8 * k));
+            differences[k] += worker->parts[k][i] != byte;
+            worker->parts[k][i] = byte;
+        }
+    }
+    char report[256] = "", repaired[3 * PARTS + 1] = "";
+    int written = 0, unrepaired = 0;
+    for (int k = 0; k < PARTS; k++) {
+        if (set->fds[k] < 0 || (differences[k] == 0 && !(failed >> (6 - k) & 1))) {
+            continue;
+        }
+        snprintf(report + strlen(report), sizeof(report) - strlen(report), ", part %d: %zu bytes differ%s", k, differences[k],
+                 failed >> (6 - k) & 1 ? " (checksum failed)" : "");
+        // Without a checksum to confirm it, a block with undecodable codewords is left alone
+        int confirmed = set->checksums[k] != NULL ? crc32(worker->parts[k], count) == set->checksums[k][block] : uncorrectable == 0;
+        if (pool->mode != REPAIR_PARTS || differences[k] == 0) {
+            continue;
+        }
+        if (!confirmed) {
+            unrepaired = 1;
+            continue;
+        }
+        if (writeAt(set->fds[k], worker->parts[k], count, set->dataOffset + block * set->blockPartBytes) != 0) {
+            perror("Error writing repaired part");
+            return -1;
+        }
+        snprintf(repaired + strlen(repaired), sizeof(repaired) - strlen(repaired), " %d", k);
+        written = 1;
+    }
+    if (report[0] == '\0' && failed == 0 && uncorrectable == 0) {
+        return 0;
+    }
+    worker->badBlocks++;
+    worker->repairedBlocks += written && !unrepaired;
+    printf("Block %llu (part bytes %llu-%llu): %llu codewords corrected, %llu uncorrectable%s%s%s%s\n",
+           (unsigned long long)block, (unsigned long long)(block * set->blockPartBytes),
+           (unsigned long long)(block * set->blockPartBytes + count - 1), corrected, uncorrectable, report,
+           written ? ", repaired parts" : "", repaired, unrepaired ? ", not repaired" : "");
+    return 0;
+}
+
+// Function to decode 'count' bytes of every part: the bytes at the same offset of every part hold 8
+// codewords, which are gathered with one table lookup per part, corrected through the pair table two at a
+// time and written as 4 output bytes
+void decodeCodewords(const struct DecodeTables *tables, unsigned char *const *parts, size_t count, unsigned char *output,
+                     unsigned long long *corrected, unsigned long long *uncorrectable) {
+    for (size_t i = 0; i < count; i++) {
+        uint64_t codewords = partSpread[0][parts[0][i]] | partSpread[1][parts[1][i]] | partSpread[2][parts[2][i]] |
+                             partSpread[3][parts[3][i]] | partSpread[4][parts[4][i]] | partSpread[5][parts[5][i]] |
+                             partSpread[6][parts[6][i]];
+        for (int j = 0; j < 4; j++) {
+            uint64_t pair = codewords >> (16 * j);
+            uint16_t decoded = tables->pairs[(pair & 0x7F) | (pair >> 1 & 0x3F80)];
+            output[4 * i + j] = (unsigned char)decoded;
+            *corrected += (decoded >> 8) & 3;
+            *uncorrectable += decoded >> 10;
+        }
+    }
+}
+
+// Function to decode one block with decodeCodewords. A part block that fails its checksum is one more
+// erasure, as long as the other parts can decode without it. The decoded data is written out, encoded
+// again into the missing parts (REBUILD_PARTS) or checked against the parts (SCRUB_PARTS, REPAIR_PARTS)
+int decodeBlock(struct DecodeWorker *worker, uint64_t block) {
+    struct DecodePool *pool = worker->pool;
+    const struct StripeSet *set = pool->set;
+    unsigned char **parts = worker->parts;
+    uint64_t offset = block * set->blockPartBytes;
+    size_t count = set->partBytes - offset < set->blockPartBytes ? (size_t)(set->partBytes - offset) : set->blockPartBytes;
+    int usable = set->present;
+    for (int k = 0; k < PARTS; k++) {
+        if (set->fds[k] < 0) {
+            continue; // The bits of a missing part are never looked at
+        }
+        if (readAt(set->fds[k], parts[k], count, set->dataOffset + offset) != count) {
+            perror("Error reading input file");
+            return -1;
+        }
+        if (set->checksums[k] != NULL && crc32(parts[k], count) != set->checksums[k][block]) {
+            if (pool->mode == DECODE_FILE || pool->mode == REBUILD_PARTS) {
+                fprintf(stderr, "Warning: block %llu of part %d fails its checksum\n", (unsigned long long)block, k);
+            }
+            worker->checksumFailures++;
+            usable &= ~(1 << (6 - k));
+        }
+    }
+    const struct DecodeTables *tables = usableTables(worker, usable);
+    unsigned long long corrected = worker->corrected, uncorrectable = worker->uncorrectable;
+    if (tables == NULL) {
+        if (pool->mode == DECODE_FILE || pool->mode == REBUILD_PARTS) {
+            fprintf(stderr, "Warning: block %llu is damaged in too many parts, decoded as read\n", (unsigned long long)block);
+        }
+        worker->damagedBlocks++;
+        tables = &pool->tables;
+    }
+
+    unsigned char *output = worker->output;
+    decodeCodewords(tables, parts, count, output, &worker->corrected, &worker->uncorrectable);
+
+    if (pool->mode == SCRUB_PARTS || pool->mode == REPAIR_PARTS) {
+        return scrubBlock(worker, block, count, set->present & ~usable, worker->corrected - corrected,
+                          worker->uncorrectable - uncorrectable);
+    }
+    if (pool->mode == REBUILD_PARTS) {
+        // The missing parts get the bits of the corrected data, four output bytes per part byte
+        for (size_t i = 0; i < count; i++) {
+            const unsigned char *in = output + 4 * i;
+            uint64_t bytes = partPairs[in[0]] << 6 | partPairs[in[1]] << 4 | partPairs[in[2]] << 2 | partPairs[in[3]];
+            for (int k = 0; k < PARTS; k++) {
+                parts[k][i] = (unsigned char)(bytes >> (8 * k));
+            }
+        }
+        for (int k = 0; k < PARTS; k++) {
+            if (pool->rebuiltFds[k] < 0) {
+                continue;
+            }
+            if (writeAt(pool->rebuiltFds[k], parts[k], count, set->dataOffset + offset) != 0) {
+                perror("Error writing rebuilt part");
+                return -1;
+            }
+            if (pool->rebuiltChecksums[k] != NULL) {
+                pool->rebuiltChecksums[k][block] = crc32(parts[k], count);
+            }
+        }
+        return 0;
+    }
+    uint64_t outputOffset = offset * 4;
+    size_t outputBytes = set->outputBytes - outputOffset < count * 4 ? (size_t)(set->outputBytes - outputOffset) : count * 4;
+    if (writeAt(pool->outputFd, output, outputBytes, outputOffset) != 0) {
+        perror("Error writing decoded file");
+        return -1;
+    }
+    return 0;
+}
+
+// Function to check the part blocks of a lane code block after decoding (-S): a part block that failed
+// its checksum or had a lane corrected held an error. With REPAIR_PARTS those parts are written back in
+// place, as long as the new part block matches its checksum
+int scrubLaneBlock(struct DecodeWorker *worker, uint64_t block, size_t count, const unsigned char *failed,
+                   const unsigned char *corrected, unsigned long long fixed, unsigned long long uncorrectable) {
+    struct DecodePool *pool = worker->pool;
+    const struct StripeSet *set = pool->set;
+    char report[1024] = "", repaired[3 * STRIPE_MAX_PARTS + 1] = "";
+    int written = 0, unrepaired = 0;
+    for (int k = 0; k < set->parts; k++) {
+        int lanes = 0;
+        for (int l = k * set->lanesPerPart; l < (k + 1) * set->lanesPerPart; l++) {
+            lanes += corrected[l];
+        }
+        if (set->fds[k] < 0 || (lanes == 0 && !failed[k])) {
+            continue;
+        }
+        snprintf(report + strlen(report), sizeof(report) - strlen(report), ", part %d: %s", k,
+                 failed[k] ? "checksum failed" : "lanes corrected");
+        if (pool->mode != REPAIR_PARTS) {
+            continue;
+        }
+        if (crc32(worker->parts[k], count) != set->checksums[k][block]) {
+            unrepaired = 1;
+            continue;
+        }
+        if (writeAt(set->fds[k], worker->parts[k], count, set->dataOffset + block * set->blockPartBytes) != 0) {
+            perror("Error writing repaired part");
+            return -1;
+        }
+        snprintf(repaired + strlen(repaired), sizeof(repaired) - strlen(repaired), " %d", k);
+        written = 1;
+    }
+    if (report[0] == '\0' && uncorrectable == 0) {
+        return 0;
+    }
+    worker->badBlocks++;
+    worker->repairedBlocks += written && !unrepaired && uncorrectable == 0;
+    printf("Block %llu (part bytes %llu-%llu): %llu codewords corrected, %llu uncorrectable%s%s%s%s\n",
+           (unsigned long long)block, (unsigned long long)(block * set->blockPartBytes),
+           (unsigned long long)(block * set->blockPartBytes + count - 1), fixed, uncorrectable, report,
+           written ? ", repaired parts" : "", repaired, unrepaired ? ", not repaired" : "");
+    return 0;
+}
+
+// Function to read the part blocks of a block of a lane code or Reed-Solomon set: the lanes of a missing
+// part, or of a part block that fails its checksum ('failed'), are marked in 'erased'. Returns the
+// erased lanes, -1 on a read error
+int readPartBlocks(struct DecodeWorker *worker, uint64_t block, size_t count, unsigned char *erased, unsigned char *failed) {
+    struct DecodePool *pool = worker->pool;
+    const struct StripeSet *set = pool->set;
+    int erasures = 0;
+    for (int k = 0; k < set->parts; k++) {
+        if (set->fds[k] >= 0) {
+            if (readAt(set->fds[k], worker->parts[k], count, set->dataOffset + block * set->blockPartBytes) != count) {
+                perror("Error reading input file");
+                return -1;
+            }
+            if (crc32(worker->parts[k], count) == set->checksums[k][block]) {
+                continue;
+            }
+            if (pool->mode == DECODE_FILE || pool->mode == REBUILD_PARTS) {
+                fprintf(stderr, "Warning: block %llu of part %d fails its checksum\n", (unsigned long long)block, k);
+            }
+            worker->checksumFailures++;
+            failed[k] = 1;
+        }
+        memset(erased + k * set->lanesPerPart, 1, set->lanesPerPart);
+        erasures += set->lanesPerPart;
+    }
+    return erasures;
+}
+
+// Function to note a block with more erasures than the code can restore
+void noteDamagedBlock(struct DecodeWorker *worker, uint64_t block) {
+    if (worker->pool->mode == DECODE_FILE || worker->pool->mode == REBUILD_PARTS) {
+        fprintf(stderr, "Warning: block %llu is damaged in too many parts, decoded as read\n", (unsigned long long)block);
+    }
+    worker->damagedBlocks++;
+}
+
+// Function to write the restored part blocks of the parts being rebuilt
+int writeRebuiltParts(struct DecodeWorker *worker, uint64_t block, size_t count) {
+    struct DecodePool *pool = worker->pool;
+    const struct StripeSet *set = pool->set;
+    for (int k = 0; k < set->parts; k++) {
+        if (pool->rebuiltFds[k] < 0) {
+            continue;
+        }
+        if (writeAt(pool->rebuiltFds[k], worker->parts[k], count, set->dataOffset + block * set->blockPartBytes) != 0) {
+            perror("Error writing rebuilt part");
+            return -1;
+        }
+        pool->rebuiltChecksums[k][block] = crc32(worker->parts[k], count);
+    }
+    return 0;
+}
+
+// Function to write the data lanes of a block, one after the other, as the decoded block
+int writeDataLanes(struct DecodeWorker *worker, uint64_t block, const unsigned char *const *dataLanes, int count, size_t laneBytes) {
+    const struct StripeSet *set = worker->pool->set;
+    uint64_t outputOffset = block * set->blockOutputBytes;
+    size_t outputBytes = set->outputBytes - outputOffset < set->blockOutputBytes ? (size_t)(set->outputBytes - outputOffset)
+                                                                                 : set->blockOutputBytes;
+    for (int j = 0; j < count && (size_t)j * laneBytes < outputBytes; j++) {
+        size_t start = j * laneBytes;
+        memcpy(worker->output + start, dataLanes[j], outputBytes - start < laneBytes ? outputBytes - start : laneBytes);
+    }
+    if (writeAt(worker->pool->outputFd, worker->output, outputBytes, outputOffset) != 0) {
+        perror("Error writing decoded file");
+        return -1;
+    }
+    return 0;
+}
+
+// Function to decode one block of a lane code: the lanes of every part are read as they lie, the lanes of
+// missing parts and of part blocks that fail their checksum are erased and restored from the checks, and
+// with nothing erased single-bit errors are corrected. The data lanes, one after the other, are the
+// decoded block; rebuilding and scrubbing use the restored part blocks as they are
+int decodeLaneBlock(struct DecodeWorker *worker, uint64_t block) {
+    struct DecodePool *pool = worker->pool;
+    const struct StripeSet *set = pool->set;
+    const struct LaneCode *code = &set->lanes;
+    uint64_t offset = block * set->blockPartBytes;
+    size_t count = set->partBytes - offset < set->blockPartBytes ? (size_t)(set->partBytes - offset) : set->blockPartBytes;
+    size_t laneBytes = count / set->lanesPerPart;
+    unsigned char erased[LANE_MAX] = { 0 }, corrected[LANE_MAX] = { 0 }, failed[STRIPE_MAX_PARTS] = { 0 };
+    uint64_t *lanes[LANE_MAX];
+    for (int l = 0; l < code->lanes; l++) {
+        lanes[l] = (uint64_t *)(worker->parts[l / set->lanesPerPart] + l % set->lanesPerPart * laneBytes);
+    }
+    int erasures = readPartBlocks(worker, block, count, erased, failed);
+    if (erasures < 0) {
+        return -1;
+    }
+
+    struct LaneErasures solution;
+    unsigned long long fixed = 0, uncorrectable = 0;
+    if (erasures > 0 && solveLaneErasures(code, erased, &solution) == 0) {
+        restoreLanes(code, &solution, erased, lanes, worker->checks, laneBytes / 8);
+        uncorrectable = countFailedChecks(code, lanes, worker->checks, laneBytes / 8);
+    } else {
+        if (erasures > 0) {
+            noteDamagedBlock(worker, block);
+        }
+        fixed = correctLanes(code, lanes, worker->checks, laneBytes / 8, &uncorrectable, corrected);
+    }
+    worker->corrected += fixed;
+    worker->uncorrectable += uncorrectable;
+
+    if (pool->mode == SCRUB_PARTS || pool->mode == REPAIR_PARTS) {
+        return scrubLaneBlock(worker, block, count, failed, corrected, fixed, uncorrectable);
+    }
+    if (pool->mode == REBUILD_PARTS) {
+        return writeRebuiltParts(worker, block, count);
+    }
+    const unsigned char *dataLanes[LANE_MAX];
+    for (int j = 0; j < code->dataLanes; j++) {
+        dataLanes[j] = (const unsigned char *)lanes[code->dataLane[j]];
+    }
+    return writeDataLanes(worker, block, dataLanes, code->dataLanes, laneBytes);
+}
+
+// Function to decode one block of a Reed-Solomon set: missing parts and part blocks that fail their
+// checksum are erased and restored from k of the others, and the data parts, one after the other, are the
+// decoded block. Scrubbing with nothing erased encodes the parity again: a parity byte that differs from
+// the one read is an error the checksums missed, which erasure decoding cannot place
+int decodeReedSolomonBlock(struct DecodeWorker *worker, uint64_t block) {
+    struct DecodePool *pool = worker->pool;
+    const struct StripeSet *set = pool->set;
+    const struct ReedSolomon *code = &set->rs;
+    uint64_t offset = block * set->blockPartBytes;
+    size_t count = set->partBytes - offset < set->blockPartBytes ? (size_t)(set->partBytes - offset) : set->blockPartBytes;
+    unsigned char erased[STRIPE_MAX_PARTS] = { 0 }, corrected[STRIPE_MAX_PARTS] = { 0 }, failed[STRIPE_MAX_PARTS] = { 0 };
+    int erasures = readPartBlocks(worker, block, count, erased, failed);
+    if (erasures < 0) {
+        return -1;
+    }
+
+    unsigned long long uncorrectable = 0;
+    int scrub = pool->mode == SCRUB_PARTS || pool->mode == REPAIR_PARTS;
+    if (erasures > 0) {
+        if (solveReedSolomon(code, erased, &worker->rsErasures) == 0) {
+            restoreReedSolomon(code, &worker->rsErasures, worker->parts, count);
+        } else {
+            noteDamagedBlock(worker, block);
+        }
+    } else if (scrub) {
+        for (int j = 0; j < code->parityParts; j++) {
+            const unsigned char *parity = worker->parts[code->dataParts + j];
+            memset(worker->output, 0, count);
+            for (int d = 0; d < code->dataParts; d++) {
+                gfMultiplyAdd(code->parity[j][d], worker->parts[d], worker->output, count);
+            }
+            for (size_t i = 0; i < count; i++) {
+                uncorrectable += worker->output[i] != parity[i];
+            }
+        }
+    }
+    worker->uncorrectable += uncorrectable;
+
+    if (scrub) {
+        return scrubLaneBlock(worker, block, count, failed, corrected, 0, uncorrectable);
+    }
+    if (pool->mode == REBUILD_PARTS) {
+        return writeRebuiltParts(worker, block, count);
+    }
+    return writeDataLanes(worker, block, (const unsigned char *const *)worker->parts, code->dataParts, count);
+}
+
+// Function run by every decoding thread: takes blocks until none are left
+void *decodeWorker(void *argument) {
+    struct DecodeWorker *worker = (struct DecodeWorker *)argument;
+    int64_t block;
+    while ((block = takeBlock(worker->pool)) >= 0) {
+        const struct StripeSet *set = worker->pool->set;
+        int status = set->lanes.lanes > 0    ? decodeLaneBlock(worker, (uint64_t)block)
+                     : set->rs.dataParts > 0 ? decodeReedSolomonBlock(worker, (uint64_t)block)
+                                             : decodeBlock(worker, (uint64_t)block);
+        if (status != 0) {
+            pthread_mutex_lock(&worker->pool->lock);
+            worker->pool->failed = 1;
+            pthread_mutex_unlock(&worker->pool->lock);
+        }
+    }
+    return NULL;
+}
+
+// Function to write the header and checksum table of every rebuilt part
+int finishRebuiltParts(struct DecodePool *pool) {
+    const struct StripeSet *set = pool->set;
+    for (int k = 0; k < set->parts; k++) {
+        if (pool->rebuiltChecksums[k] == NULL) {
+            continue;
+        }
+        struct StripeHeader header = set->header;
+        unsigned char bytes[STRIPE_HEADER_SIZE];
+        unsigned char *table = (unsigned char *)malloc(4 * (size_t)set->blockCount + 1);
+        if (table == NULL) {
+            printf("Error: Out of memory\n");
+            return -1;
+        }
+        for (uint64_t b = 0; b < set->blockCount; b++) {
+            putLittleEndian(table + 4 * b, pool->rebuiltChecksums[k][b], 4);
+        }
+        header.part = k;
+        formatStripeHeader(bytes, &header);
+        int failed = writeAt(pool->rebuiltFds[k], table, 4 * (size_t)set->blockCount, set->dataOffset + set->partBytes) != 0 ||
+                     writeAt(pool->rebuiltFds[k], bytes, STRIPE_HEADER_SIZE, 0) != 0;
+        free(table);
+        if (failed) {
+            perror("Error writing rebuilt part");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Function to decode the part files of a stripe set, to write its missing parts again, or to scrub it (see
+// DecodeMode). Blocks are independent, so 'threads' threads each take the next block, read it from every
+// part with pread and write their output with pwrite; 'rate' limits the part bytes read per second
+int decodeParts(const char *filename, const char *outputFilename, unsigned long long limit, enum DecodeMode mode, int threads,
+                double rate) {
+    struct StripeSet set;
+    struct DecodePool pool;
+    int rebuild = mode == REBUILD_PARTS, scrub = mode == SCRUB_PARTS || mode == REPAIR_PARTS;
+    if (openStripeSet(filename, &set, limit, mode == REPAIR_PARTS) != 0) {
+        return 1;
+    }
+    memset(&pool, 0, sizeof(pool));
+    pool.set = &set;
+    pool.mode = mode;
+    pool.outputFd = -1;
+    pool.rate = rate;
+    int restorable;
+    if (set.lanes.lanes > 0) {
+        unsigned char erased[LANE_MAX] = { 0 };
+        struct LaneErasures solution;
+        for (int k = 0; k < set.parts; k++) {
+            memset(erased + k * set.lanesPerPart, set.fds[k] < 0, set.lanesPerPart);
+        }
+        restorable = solveLaneErasures(&set.lanes, erased, &solution) == 0;
+    } else if (set.rs.dataParts > 0) {
+        restorable = set.parts - set.openParts <= set.rs.parityParts;
+    } else if ((restorable = buildErasureTable(&pool.tables, set.present) == 0)) {
+        buildPairTable(&pool.tables);
+    }
+    if (!restorable) {
+        fprintf(stderr, "Error: missing parts:%s of %s, the remaining parts cannot restore the data\n", set.missing, filename);
         return 1;
     }
+    if (set.openParts != set.parts) {
+        fprintf(stderr, scrub ? "Missing parts:%s, scrubbing the others (-r rebuilds them)\n" : "Missing parts:%s, decoding from the others\n",
+                set.missing);
+    } else if (rebuild) {
+        printf("All parts of %s are present, nothing to rebuild\n", filename);
+        return 0;
+    }
 
-    FILE *inputFiles[4];
-    char *partSuffixes[4] = { ".part2", ".part4", ".part5", ".part6" };
-    for (int i = 0; i < 4; i++) {
-        char filename[100];
-        snprintf(filename, sizeof(filename), "%s%s", argv[2], partSuffixes[i]);
-        inputFiles[i] = fopen(filename, "r");
-        if (inputFiles[i] == NULL) {
-            perror("Error opening input file");
+    // A decoded file or rebuilt part gets its final size first, so blocks can be written in any order
+    pool.blockCount = set.blockCount;
+    for (int k = 0; k < set.parts; k++) {
+        pool.rebuiltFds[k] = -1;
+        if (!rebuild || set.fds[k] >= 0) {
+            continue;
+        }
+        char partFilename[4096];
+        snprintf(partFilename, sizeof(partFilename), "%s.part%d", filename, k);
+        pool.rebuiltFds[k] = open(partFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (pool.rebuiltFds[k] < 0 || ftruncate(pool.rebuiltFds[k], (off_t)(set.dataOffset + set.partBytes)) != 0) {
+            perror(partFilename);
+            return 1;
+        }
+        if (set.headers && (pool.rebuiltChecksums[k] = (uint32_t *)malloc(sizeof(uint32_t) * (set.blockCount + 1))) == NULL) {
+            printf("Error: Out of memory\n");
             return 1;
         }
     }
+    if (mode == DECODE_FILE) {
+        pool.outputFd = open(outputFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (pool.outputFd < 0 || ftruncate(pool.outputFd, (off_t)set.outputBytes) != 0) {
+            perror("Error creating decoded file");
+            return 1;
+        }
+        // Blocks past the end of the output are not decoded
+        pool.blockCount = (set.outputBytes + set.blockOutputBytes - 1) / set.blockOutputBytes;
+    }
 
-    // Create a new file for the decoded data
-    FILE *decodedFile = fopen(strcat(argv[2], ".2"), "w");
+    if ((uint64_t)threads > pool.blockCount) {
+        threads = pool.blockCount > 0 ? (int)pool.blockCount : 1;
+    }
+    struct DecodeWorker *workers = (struct DecodeWorker *)calloc(threads, sizeof(struct DecodeWorker));
+    if (workers == NULL) {
+        printf("Error: Out of memory\n");
+        return 1;
+    }
+    for (int t = 0; t < threads; t++) {
+        workers[t].pool = &pool;
+        workers[t].output = (unsigned char *)malloc(set.blockOutputBytes);
+        for (int k = 0; k < set.parts; k++) {
+            // A missing part reads as zeros, which its spread table maps to no bits
+            workers[t].parts[k] = (unsigned char *)calloc(set.blockPartBytes, 1);
+            if (workers[t].parts[k] == NULL) {
+                workers[t].output = NULL;
+            }
+        }
+        for (int b = 0; b < set.lanes.rows; b++) {
+            workers[t].checks[b] = (uint64_t *)malloc(LANE_STRIP_WORDS * sizeof(uint64_t));
+            if (workers[t].checks[b] == NULL) {
+                workers[t].output = NULL;
+            }
+        }
+        if (workers[t].output == NULL) {
+            printf("Error: Out of memory\n");
+            return 1;
+        }
+    }
+    pthread_mutex_init(&pool.lock, NULL);
+    pool.start = monotonicSeconds();
+    pthread_t ids[MAX_THREADS];
+    int started = 0;
+    for (; started < threads - 1; started++) {
+        if (pthread_create(&ids[started], NULL, decodeWorker, &workers[started + 1]) != 0) {
+            break;
+        }
+    }
+    decodeWorker(&workers[0]);
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    pthread_mutex_destroy(&pool.lock);
+
+    double seconds = monotonicSeconds() - pool.start;
+    unsigned long long corrected = 0, uncorrectable = 0, checksumFailures = 0, damagedBlocks = 0, badBlocks = 0, repairedBlocks = 0;
+    for (int t = 0; t < threads; t++) {
+        badBlocks += workers[t].badBlocks;
+        repairedBlocks += workers[t].repairedBlocks;
+        corrected += workers[t].corrected;
+        uncorrectable += workers[t].uncorrectable;
+        checksumFailures += workers[t].checksumFailures;
+        damagedBlocks += workers[t].damagedBlocks;
+        for (int k = 0; k < set.parts; k++) {
+            free(workers[t].parts[k]);
+        }
+        for (int b = 0; b < set.lanes.rows; b++) {
+            free(workers[t].checks[b]);
+        }
+        free(workers[t].output);
+    }
+    free(workers);
+    int status = pool.failed;
+    if (rebuild && !pool.failed && finishRebuiltParts(&pool) != 0) {
+        status = 1;
+    }
+    for (int k = 0; k < set.parts; k++) {
+        if (set.fds[k] >= 0) {
+            close(set.fds[k]);
+        }
+        if (pool.rebuiltFds[k] >= 0 && close(pool.rebuiltFds[k]) != 0) {
+            perror("Error writing rebuilt part");
+            status = 1;
+        }
+        free(set.checksums[k]);
+        free(pool.rebuiltChecksums[k]);
+    }
+
+    if (scrub) {
+        uint64_t bytesRead = set.partBytes * set.openParts;
+        printf("Scrubbed %llu blocks of %s in %.2f s (%.1f MB/s): %llu with errors, %llu repaired, %llu part blocks failed "
+               "their checksum, corrected %llu single-bit errors\n", (unsigned long long)pool.blockCount, filename, seconds,
+               seconds > 0 ? bytesRead / seconds / 1e6 : 0.0, badBlocks, repairedBlocks, checksumFailures, corrected);
+        return status != 0 || badBlocks > repairedBlocks || set.openParts != set.parts;
+    }
+    if (checksumFailures > 0) {
+        fprintf(stderr, "Warning: %llu part blocks failed their checksum\n", checksumFailures);
+    }
+    if (damagedBlocks > 0) {
+        fprintf(stderr, "Warning: %llu blocks had too few intact parts and may be damaged\n", damagedBlocks);
+    }
+    if (uncorrectable > 0) {
+        fprintf(stderr, "Warning: %llu codewords have an error that the remaining parts cannot correct\n", uncorrectable);
+    }
+    if (rebuild) {
+        printf("Rebuilt parts%s of %s (%llu codewords), corrected %llu single-bit errors\n", set.missing, filename,
+               (unsigned long long)(set.rs.dataParts > 0 ? set.partBytes : set.partBytes * 8 / (set.lanesPerPart > 0 ? set.lanesPerPart : 1)),
+               corrected);
+        return status;
+    }
+    if (close(pool.outputFd) != 0) {
+        perror("Error writing decoded file");
+        status = 1;
+    }
+    printf("Decoded %llu bytes into %s, corrected %llu single-bit errors\n", (unsigned long long)set.outputBytes, outputFilename, corrected);
+    return status;
+}
 
+// Function to give the value of a hex digit, -1 for any other character
+static inline int hexValue(int c) {
+    return c >= '0' && c <= '9' ? c - '0' : c >= 'A' && c <= 'F' ? c - 'A' + 10 : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+}
+
+// Function to read up to 'count' bytes of a hex text part, skipping line breaks; returns the bytes read,
+// or -1 if the part holds anything but pairs of hex digits
+ssize_t readHexText(FILE *file, unsigned char *bytes, size_t count) {
+    size_t n = 0;
+    int high = -1, c;
+    while (n < count && (c = getc(file)) != EOF) {
+        if (c == '\n' || c == '\r') {
+            continue;
+        }
+        int value = hexValue(c);
+        if (value < 0) {
+            return -1;
+        }
+        if (high < 0) {
+            high = value;
+        } else {
+            bytes[n++] = (unsigned char)(high << 4 | value);
+            high = -1;
+        }
+    }
+    return high < 0 ? (ssize_t)n : -1;
+}
+
+// Function to decode the hex text parts of raid.c -t (-t): the text of every part is turned back into part
+// bytes one block at a time and decoded with decodeCodewords, so single-bit errors are corrected and any 2
+// missing parts are restored. Text parts have no header, 'limit' drops the padding after the original bytes
+int decodeTextParts(const char *filename, const char *outputFilename, unsigned long long limit) {
+    FILE *inputFiles[PARTS];
+    unsigned char *parts[PARTS];
+    unsigned char *output = (unsigned char *)malloc(4 * PART_BLOCK_SIZE);
+    char missing[3 * PARTS + 1] = "";
+    int present = 0;
+    for (int k = 0; k < PARTS; k++) {
+        char partFilename[4096];
+        snprintf(partFilename, sizeof(partFilename), "%s.part%d", filename, k);
+        inputFiles[k] = fopen(partFilename, "r");
+        parts[k] = (unsigned char *)calloc(PART_BLOCK_SIZE, 1); // Missing parts stay zero, their bits are ignored
+        if (parts[k] == NULL) {
+            output = NULL;
+        }
+        if (inputFiles[k] == NULL) {
+            snprintf(missing + strlen(missing), sizeof(missing) - strlen(missing), " %d", k);
+            continue;
+        }
+        setvbuf(inputFiles[k], NULL, _IOFBF, INPUT_BUFFER_SIZE);
+        present |= 1 << (6 - k);
+    }
+    if (output == NULL) {
+        printf("Error: Out of memory\n");
+        return 1;
+    }
+    struct DecodeTables tables;
+    if (present == 0 || buildErasureTable(&tables, present) != 0) {
+        fprintf(stderr, "Error: missing parts:%s of %s, the remaining parts cannot restore the data\n", missing, filename);
+        return 1;
+    }
+    buildPairTable(&tables);
+    if (present != 0x7F) {
+        fprintf(stderr, "Missing parts:%s, decoding from the others\n", missing);
+    }
+    FILE *decodedFile = fopen(outputFilename, "wb");
     if (decodedFile == NULL) {
         perror("Error creating decoded file");
         return 1;
     }
 
-    char binaryData[8];
-    char decodedData[5];
-    int bytesRead = 0;
-
-    while (1) {
-        int binaryDataIndex = 0;
-        for (int i = 0; i < 4; i++) {
-            char hexChar;
-            if (fscanf(inputFiles[i], "%c", &hexChar) == 1) {
-                char binaryChunk[5];
-                hexToBinary(hexChar, binaryChunk);
-                for (int j = 0; j < 4; j++) {
-                    binaryData[binaryDataIndex++] = binaryChunk[j];
-                }
-            } else {
-                // If we reach the end of any input file, break the loop
-                bytesRead = -1;
-                break;
+    unsigned long long corrected = 0, uncorrectable = 0;
+    uint64_t outputBytes = 0;
+    int status = 0;
+    while (status == 0) {
+        ssize_t count = -1;
+        for (int k = 0; k < PARTS && status == 0; k++) {
+            if (inputFiles[k] == NULL) {
+                continue;
+            }
+            ssize_t n = readHexText(inputFiles[k], parts[k], PART_BLOCK_SIZE);
+            if (n < 0) {
+                fprintf(stderr, "Error: part %d of %s is not hex text\n", k, filename);
+                status = 1;
+            } else if (count >= 0 && n != count) {
+                fprintf(stderr, "Error: the text parts of %s differ in length\n", filename);
+                status = 1;
             }
+            count = n;
         }
-
-        if (bytesRead == -1) {
+        if (status != 0 || count == 0) {
             break;
         }
-
-        // Decode and write to the decoded file
-        decodeHamming74(binaryData, decodedData);
-
-        // Write the 4-bit binary data to the decoded file
-        for (int j = 0; j < 4; j++) {
-            fputc(binaryToHex(decodedData + j), decodedFile);
+        decodeCodewords(&tables, parts, (size_t)count, output, &corrected, &uncorrectable);
+        size_t bytes = 4 * (size_t)count;
+        if (limit > 0 && outputBytes + bytes > limit) {
+            bytes = limit > outputBytes ? (size_t)(limit - outputBytes) : 0;
+        }
+        if (fwrite(output, 1, bytes, decodedFile) != bytes) {
+            perror("Error writing decoded file");
+            status = 1;
+        }
+        outputBytes += bytes;
+    }
+    for (int k = 0; k < PARTS; k++) {
+        if (inputFiles[k] != NULL) {
+            fclose(inputFiles[k]);
         }
+        free(parts[k]);
     }
+    free(output);
+    if (fclose(decodedFile) != 0 && status == 0) {
+        perror("Error writing decoded file");
+        status = 1;
+    }
+    if (status != 0) {
+        return 1;
+    }
+    if (limit > outputBytes) {
+        fprintf(stderr, "Warning: the parts hold only %llu of %llu bytes\n", (unsigned long long)outputBytes, limit);
+    }
+    if (uncorrectable > 0) {
+        fprintf(stderr, "Warning: %llu codewords have an error that the remaining parts cannot correct\n", uncorrectable);
+    }
+    printf("Decoded %llu bytes into %s, corrected %llu single-bit errors\n", (unsigned long long)outputBytes, outputFilename, corrected);
+    return 0;
+}
 
-    // Close all input and output files
-    for (int i = 0; i < 4; i++) {
-        fclose(inputFiles[i]);
+int main(int argc, char *argv[]) {
+    char *filename = NULL;
+    unsigned long long size = 0;
+    int text = 0;
+    enum DecodeMode mode = DECODE_FILE;
+    double rate = 0;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            filename = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            size = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (i + 1 < argc && atoi(argv[i + 1]) >= 1 && atoi(argv[i + 1]) <= MAX_THREADS) {
+                threads = atoi(argv[++i]);
+            } else {
+                printf("Error: -j needs a thread count from 1 to %d\n", MAX_THREADS);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-t") == 0) {
+            text = 1;
+        } else if (strcmp(argv[i], "-r") == 0 && mode == DECODE_FILE) {
+            mode = REBUILD_PARTS;
+        } else if (strcmp(argv[i], "-S") == 0 && (mode == DECODE_FILE || mode == SCRUB_PARTS)) {
+            mode = SCRUB_PARTS;
+        } else if (strcmp(argv[i], "-R") == 0 && (mode == DECODE_FILE || mode == SCRUB_PARTS)) {
+            mode = REPAIR_PARTS;
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc && atof(argv[i + 1]) > 0) {
+            rate = atof(argv[++i]) * 1e6;
+        } else {
+            filename = NULL;
+            break;
+        }
+    }
+    if (filename == NULL || (text && mode != DECODE_FILE)) {
+        printf("Usage: %s -f <filename> [-j <threads>] [-s <number of bytes>] [-r | -S | -R] [-m <MB/s>] [-t]\n", argv[0]);
+        printf("       -j decodes blocks on this many threads (default: one per processor)\n");
+        printf("       -s drops the padding after the original number of bytes (parts without a stripe header)\n");
+        printf("       -r rebuilds missing part files from the others instead of decoding\n");
+        printf("       -S scrubs the parts: reports the blocks with errors and writes nothing\n");
+        printf("       -R scrubs and repairs: writes corrected blocks back into the parts\n");
+        printf("       -m caps the part bytes read at this many MB/s\n");
+        printf("       -t decodes the hex text parts of raid -t (-s drops their padding)\n");
+        return 1;
     }
-    fclose(decodedFile);
 
-    return 0;
+    // The decoded data goes to a new file next to the parts
+    char outputFilename[4096];
+    snprintf(outputFilename, sizeof(outputFilename), "%s.2", filename);
+    buildDecodeTables();
+    if (text) {
+        return decodeTextParts(filename, outputFilename, size);
+    }
+    if (threads < 1 || threads > MAX_THREADS) {
+        threads = threads < 1 ? 1 : MAX_THREADS;
+    }
+    buildCrcTables();
+    buildGfTables();
+    pickGfKernel();
+    return decodeParts(filename, outputFilename, size, mode, (int)threads, rate);
 }
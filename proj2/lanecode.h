@@ -0,0 +1,231 @@
+#ifndef LANECODE_H
+#define LANECODE_H
+
+#include <stdint.h>
+#include <string.h>
+
+// Lane codes shared by raid.c and diar.c: Hamming(15,11) and extended Hamming SECDED(72,64), laid out
+// in lanes. A block of input is cut into one run of bytes per data lane, and codeword i is bit i of every
+// lane, so every parity check is a word-wide XOR of whole lanes and 64 codewords are handled per word.
+// Lane k is codeword position k + 1 for Hamming(15,11) (parity at positions 1, 2, 4 and 8) and position
+// k for SECDED(72,64) (parity at 1, 2, 4, ..., 64, and lane 0 the parity of all other lanes).
+
+#define LANE_MAX 72 // Lanes of the widest code
+#define LANE_MAX_ROWS 8 // Parity checks of the widest code
+#define LANE_STRIP_WORDS 128 // Words of every lane handled at a time, so the check words stay in cache
+
+// Struct for the shape of a lane code
+struct LaneCode {
+    int code;                                // STRIPE_CODE_HAMMING1511 or STRIPE_CODE_SECDED7264
+    int lanes;                               // Codeword bits, one lane each
+    int rows;                                // Parity checks
+    int dataLanes;
+    unsigned char columns[LANE_MAX];         // Checks that cover each lane (bit b for check b)
+    unsigned char dataLane[LANE_MAX];        // Lane of every data lane, in input order
+    unsigned char parityLanes[LANE_MAX_ROWS];
+};
+
+// Struct for how to restore a set of erased lanes: erased lane i is the XOR of the check words selected by
+// rows[i], taken over the lanes that are not erased
+struct LaneErasures {
+    int count;
+    unsigned char lanes[LANE_MAX_ROWS];
+    unsigned char rows[LANE_MAX_ROWS];
+};
+
+// Function to set up a lane code from its stripe code number, returns -1 for a code that is not a lane code
+static inline int setupLaneCode(struct LaneCode *laneCode, int code) {
+    memset(laneCode, 0, sizeof(*laneCode));
+    laneCode->code = code;
+    if (code == STRIPE_CODE_HAMMING1511) {
+        laneCode->lanes = 15;
+        laneCode->rows = 4;
+        for (int k = 0; k < 15; k++) {
+            laneCode->columns[k] = (unsigned char)(k + 1);
+        }
+    } else if (code == STRIPE_CODE_SECDED7264) {
+        laneCode->lanes = 72;
+        laneCode->rows = 8;
+        for (int k = 0; k < 72; k++) {
+            laneCode->columns[k] = (unsigned char)(k | 0x80); // Check 7 is the overall parity
+        }
+    } else {
+        return -1;
+    }
+    int parity = 0;
+    for (int k = 0; k < laneCode->lanes; k++) {
+        int position = laneCode->code == STRIPE_CODE_HAMMING1511 ? k + 1 : k;
+        if ((position & (position - 1)) == 0) {
+            laneCode->parityLanes[parity++] = (unsigned char)k;
+        } else {
+            laneCode->dataLane[laneCode->dataLanes++] = (unsigned char)k;
+        }
+    }
+    return 0;
+}
+
+// Function to work out how to restore the erased lanes ('erased' has a nonzero byte for each) from the
+// checks: Gauss-Jordan elimination over GF(2) on the checks' columns of the erased lanes. Returns -1 if
+// the columns are not independent, so the checks cannot tell the erased bits apart
+static inline int solveLaneErasures(const struct LaneCode *laneCode, const unsigned char *erased, struct LaneErasures *solution) {
+    // Row b of the system: bit i is check b's coefficient for erased lane i, bits 16 on say which checks
+    // were combined into it
+    uint32_t system[LANE_MAX_ROWS];
+    solution->count = 0;
+    for (int k = 0; k < laneCode->lanes; k++) {
+        if (erased[k]) {
+            if (solution->count == laneCode->rows) {
+                return -1;
+            }
+            solution->lanes[solution->count++] = (unsigned char)k;
+        }
+    }
+    for (int b = 0; b < laneCode->rows; b++) {
+        system[b] = 1u << (16 + b);
+        for (int i = 0; i < solution->count; i++) {
+            system[b] |= (uint32_t)(laneCode->columns[solution->lanes[i]] >> b & 1) << i;
+        }
+    }
+    for (int i = 0; i < solution->count; i++) {
+        int pivot = i;
+        while (pivot < laneCode->rows && !(system[pivot] >> i & 1)) {
+            pivot++;
+        }
+        if (pivot == laneCode->rows) {
+            return -1;
+        }
+        uint32_t row = system[pivot];
+        system[pivot] = system[i];
+        system[i] = row;
+        for (int b = 0; b < laneCode->rows; b++) {
+            if (b != i && (system[b] >> i & 1)) {
+                system[b] ^= row;
+            }
+        }
+    }
+    for (int i = 0; i < solution->count; i++) {
+        solution->rows[i] = (unsigned char)(system[i] >> 16);
+    }
+    return 0;
+}
+
+// Function to compute the check words of words 'from' to 'to' of every lane into 'checks' (one run of
+// LANE_STRIP_WORDS words per check), leaving out the erased lanes ('erased' may be NULL): check word b
+// is the XOR of the lanes that check b covers, all zeros for a codeword that is intact
+static inline void computeLaneChecks(const struct LaneCode *laneCode, uint64_t *const *lanes, const unsigned char *erased,
+                                     uint64_t **checks, size_t from, size_t to) {
+    for (int b = 0; b < laneCode->rows; b++) {
+        memset(checks[b], 0, (to - from) * sizeof(uint64_t));
+    }
+    for (int k = 0; k < laneCode->lanes; k++) {
+        if (erased != NULL && erased[k]) {
+            continue;
+        }
+        for (int b = 0; b < laneCode->rows; b++) {
+            if (laneCode->columns[k] >> b & 1) {
+                uint64_t *check = checks[b];
+                const uint64_t *lane = lanes[k] + from;
+                for (size_t w = 0; w < to - from; w++) {
+                    check[w] ^= lane[w];
+                }
+            }
+        }
+    }
+}
+
+// Function to restore the erased lanes of 'words' words from the other lanes ('checks' is scratch space,
+// as for computeLaneChecks). Encoding is restoring the parity lanes from the data lanes
+static inline void restoreLanes(const struct LaneCode *laneCode, const struct LaneErasures *solution, const unsigned char *erased,
+                                uint64_t *const *lanes, uint64_t **checks, size_t words) {
+    for (size_t from = 0; from < words; from += LANE_STRIP_WORDS) {
+        size_t to = words - from < LANE_STRIP_WORDS ? words : from + LANE_STRIP_WORDS;
+        computeLaneChecks(laneCode, lanes, erased, checks, from, to);
+        for (int i = 0; i < solution->count; i++) {
+            uint64_t *lane = lanes[solution->lanes[i]];
+            memset(lane + from, 0, (to - from) * sizeof(uint64_t));
+            for (int b = 0; b < laneCode->rows; b++) {
+                if (solution->rows[i] >> b & 1) {
+                    for (size_t w = from; w < to; w++) {
+                        lane[w] ^= checks[b][w - from];
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Function to correct single-bit errors in 'words' words of every lane: a codeword whose checks match
+// the column of a lane has that lane's bit flipped. Any other failed check (two errors, for SECDED) is
+// counted in 'uncorrectable'. 'corrected' (may be NULL) gets a nonzero byte for every lane that changed;
+// returns the number of corrected codewords
+static inline unsigned long long correctLanes(const struct LaneCode *laneCode, uint64_t *const *lanes, uint64_t **checks,
+                                              size_t words, unsigned long long *uncorrectable, unsigned char *corrected) {
+    unsigned long long count = 0;
+    for (size_t from = 0; from < words; from += LANE_STRIP_WORDS) {
+        size_t to = words - from < LANE_STRIP_WORDS ? words : from + LANE_STRIP_WORDS;
+        computeLaneChecks(laneCode, lanes, NULL, checks, from, to);
+        for (size_t w = from; w < to; w++) {
+            uint64_t failed = 0, matched = 0;
+            for (int b = 0; b < laneCode->rows; b++) {
+                failed |= checks[b][w - from];
+            }
+            if (failed == 0) {
+                continue; // The common case: all 64 codewords are intact
+            }
+            for (int k = 0; k < laneCode->lanes; k++) {
+                uint64_t match = failed;
+                for (int b = 0; b < laneCode->rows && match != 0; b++) {
+                    match &= laneCode->columns[k] >> b & 1 ? checks[b][w - from] : ~checks[b][w - from];
+                }
+                if (match != 0) {
+                    lanes[k][w] ^= match;
+                    matched |= match;
+                    if (corrected != NULL) {
+                        corrected[k] = 1;
+                    }
+                }
+            }
+            count += __builtin_popcountll(matched);
+            *uncorrectable += __builtin_popcountll(failed & ~matched);
+        }
+    }
+    return count;
+}
+
+// Function to count the codewords of 'words' words whose checks fail, after erased lanes were restored
+static inline unsigned long long countFailedChecks(const struct LaneCode *laneCode, uint64_t *const *lanes, uint64_t **checks,
+                                                   size_t words) {
+    unsigned long long count = 0;
+    for (size_t from = 0; from < words; from += LANE_STRIP_WORDS) {
+        size_t to = words - from < LANE_STRIP_WORDS ? words : from + LANE_STRIP_WORDS;
+        computeLaneChecks(laneCode, lanes, NULL, checks, from, to);
+        for (size_t w = from; w < to; w++) {
+            uint64_t failed = 0;
+            for (int b = 0; b < laneCode->rows; b++) {
+                failed |= checks[b][w - from];
+            }
+            count += __builtin_popcountll(failed);
+        }
+    }
+    return count;
+}
+
+// Function to give the lane bytes of a block of 'length' input bytes: whole lanes of 'blockSize' bytes
+// per block, and for a shorter last block just enough for the input, rounded up to whole words
+static inline uint64_t blockLaneBytes(uint64_t length, uint64_t blockSize, int dataLanes) {
+    if (length == blockSize) {
+        return blockSize / dataLanes;
+    }
+    return ((length + dataLanes - 1) / dataLanes + 7) / 8 * 8;
+}
+
+// Function to give the lane bytes of a whole input of 'size' bytes
+static inline uint64_t stripeLaneBytes(uint64_t size, uint64_t blockSize, int dataLanes) {
+    uint64_t blocks = (size + blockSize - 1) / blockSize;
+    if (blocks == 0) {
+        return 0;
+    }
+    return (blocks - 1) * (blockSize / dataLanes) + blockLaneBytes(size - (blocks - 1) * blockSize, blockSize, dataLanes);
+}
+
+#endif
@@ -1,228 +1,854 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "stripe.h"
+#include "lanecode.h"
+#include "reedsolomon.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STRIPE_X86 1 // SSE2 and AVX2 slicing kernels, picked at run time
+#endif
 
-// Function to encode data using Hamming(7,4) code
-void encodeHamming74(char* data, int dataLength, char* encodedData) {
-    // Check if the input data is exactly 4 binary digits
-    if (dataLength != 4) {
-        printf("Input data must be exactly 4 binary digits.\n");
-        return;
+#define PARTS 7 // Part files, one per bit of a Hamming(7,4) codeword
+#undef BLOCK_SIZE // linux/fs.h, included by linux/io_uring.h, has its own
+#define BLOCK_SIZE (1 << 20) // Input bytes read per block, memory use stays the same for any input size
+#define PART_STRIDE (BLOCK_SIZE / 4 + 4096) // Room for one Hamming(7,4) part block, keeping every part page aligned
+#define LANE_BYTES (32 << 10) // Bytes of every lane per block with a lane code
+#define SECDED_PARTS 24 // Default part files for SECDED(72,64): 3 lanes each, so any one part can be lost
+#define RS_DATA_PARTS 4 // Default Reed-Solomon data parts (-k)
+#define RS_PARITY_PARTS 2 // Default Reed-Solomon parity parts (-m): any 2 parts can be lost, at 50% overhead
+#define OUTPUT_BUFFER_SIZE (1 << 20) // Bytes buffered per hex text part file between writes
+#define WRITE_BUFFERS 2 // Blocks of part buffers: one is encoded while the other is written
+#define URING_ENTRIES 256 // io_uring submission entries, enough for every write in flight
+#define TEXT_LINE_DIGITS 64 // Hex digits per line of a text part (-t)
+
+// Part file layout (binary, the default): a stripe header (stripe.h), then the data, where bit i of
+// part k is codeword bit k of the i-th nibble of the input (the high nibble of each byte first), most
+// significant bit first, and the last byte is padded with zeros; then a CRC-32 of every BLOCK_SIZE input
+// bytes' worth of data. Codeword bits are P1, P2, D1, P4, D2, D3, D4 with D1 the high bit of the nibble.
+// With -t each part holds only the data, as uppercase hex text, TEXT_LINE_DIGITS digits per line.
+// With -c 1511 or -c 7264 the data is in the lanes of a Hamming(15,11) or SECDED(72,64) code instead
+// (lanecode.h), a block being LANE_BYTES of every data lane. With -c rs the data parts hold the input
+// LANE_BYTES per block and part, and the parity parts a Reed-Solomon code of them (reedsolomon.h).
+
+// Struct for the code a stripe set is written with
+struct StripeCode {
+    int code;                          // STRIPE_CODE_*
+    int parts;                         // Part files
+    size_t blockSize;                  // Input bytes per block
+    size_t bufferSize;                 // Bytes of every part of a block, all parts together
+    struct LaneCode lanes;             // For a lane code: its shape,
+    unsigned char isParity[LANE_MAX];  // which lanes are parity,
+    struct LaneErasures parity;        // and how they follow from the data lanes
+    struct ReedSolomon rs;             // For Reed-Solomon: the code,
+    struct ReedSolomonErasures rsParity; // and the parity parts as erasures
+};
+
+// Hamming(7,4) codeword of every nibble, codeword bit k in bit 6 - k
+unsigned char hammingCodewords[16];
+
+// Part bits of both nibbles of a byte: byte k holds codeword bit k of the high nibble, then of the low
+// nibble, so four shifted lookups OR'd together give one output byte of every part at once
+uint64_t partPairs[256];
+
+// Function to fill the codeword table (P1 = D1^D2^D4, P2 = D1^D3^D4, P4 = D2^D3^D4), and the per-byte
+// table of part bits from it
+void buildHammingTables(void) {
+    for (int nibble = 0; nibble < 16; nibble++) {
+        int d1 = (nibble >> 3) & 1, d2 = (nibble >> 2) & 1, d3 = (nibble >> 1) & 1, d4 = nibble & 1;
+        int bits[PARTS] = { d1 ^ d2 ^ d4, d1 ^ d3 ^ d4, d1, d2 ^ d3 ^ d4, d2, d3, d4 };
+        hammingCodewords[nibble] = 0;
+        for (int k = 0; k < PARTS; k++) {
+            hammingCodewords[nibble] |= bits[k] << (6 - k);
+        }
+    }
+    for (int byte = 0; byte < 256; byte++) {
+        partPairs[byte] = 0;
+        for (int k = 0; k < PARTS; k++) {
+            uint64_t high = (hammingCodewords[byte >> 4] >> (6 - k)) & 1;
+            uint64_t low = (hammingCodewords[byte & 15] >> (6 - k)) & 1;
+            partPairs[byte] |= (high << 1 | low) << (8 * k);
+        }
     }
+}
+
+// Bit-sliced striping: 32 input bytes are 64 nibbles, and the four data bit-planes of those nibbles
+// (64-bit words, one bit per nibble in part order) are parts 2, 4, 5 and 6 as they are; the parity parts
+// are XORs of whole planes. Gathering the planes needs the sign-bit masks of SSE2 or AVX2 to beat the
+// partPairs table, which stays the portable path.
 
-    // Initialize the Hamming(7,4) encoded data array
-    char hamming74[8];
+// Function to store the 7 part words of 64 codewords, given their data bit-planes (byte m of a word is
+// byte m of the part, so the words are stored little endian)
+static inline void storeSlices(uint64_t d1, uint64_t d2, uint64_t d3, uint64_t d4, unsigned char **parts, size_t offset) {
+    uint64_t words[PARTS] = { d1 ^ d2 ^ d4, d1 ^ d3 ^ d4, d1, d2 ^ d3 ^ d4, d2, d3, d4 };
+    for (int k = 0; k < PARTS; k++) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        words[k] = __builtin_bswap64(words[k]);
+#endif
+        memcpy(parts[k] + offset, &words[k], 8);
+    }
+}
 
-    // Copy the original 4 data bits to their positions
-    hamming74[2] = data[0];
-    hamming74[4] = data[1];
-    hamming74[5] = data[2];
-    hamming74[6] = data[3];
+#ifdef STRIPE_X86
+// Function to slice with SSE2: each group of 4 input bytes is reversed and every byte paired with its
+// low nibble shifted up, so the 16 sign bits of a register are 16 nibbles in part bit order
+__attribute__((target("sse2"))) void sliceSse2(const unsigned char *input, size_t chunks, unsigned char **parts) {
+    for (size_t c = 0; c < chunks; c++, input += 32) {
+        __m128i halves[4];
+        for (int h = 0; h < 2; h++) {
+            __m128i bytes = _mm_loadu_si128((const __m128i *)(input + 16 * h));
+            bytes = _mm_shufflehi_epi16(_mm_shufflelo_epi16(bytes, 0xB1), 0xB1);
+            bytes = _mm_or_si128(_mm_slli_epi16(bytes, 8), _mm_srli_epi16(bytes, 8));
+            __m128i low = _mm_slli_epi16(bytes, 4);
+            halves[2 * h] = _mm_unpacklo_epi8(low, bytes);
+            halves[2 * h + 1] = _mm_unpackhi_epi8(low, bytes);
+        }
+        uint64_t planes[4];
+        for (int d = 0; d < 4; d++) {
+            planes[d] = 0;
+            for (int q = 0; q < 4; q++) {
+                planes[d] |= (uint64_t)(uint16_t)_mm_movemask_epi8(halves[q]) << (16 * q);
+                halves[q] = _mm_add_epi8(halves[q], halves[q]);
+            }
+        }
+        storeSlices(planes[0], planes[1], planes[2], planes[3], parts, 8 * c);
+    }
+}
 
-    // Calculate the parity bits (P1, P2, P4)
-    hamming74[0] = (hamming74[2] ^ hamming74[4] ^ hamming74[6]) ; // P1
-    hamming74[1] = (hamming74[2] ^ hamming74[5] ^ hamming74[6]) ; // P2
-    hamming74[3] = (hamming74[4] ^ hamming74[5] ^ hamming74[6]) ; // P4
+// Function to slice with AVX2, as sliceSse2 with 32 nibbles per register
+__attribute__((target("avx2"))) void sliceAvx2(const unsigned char *input, size_t chunks, unsigned char **parts) {
+    const __m256i reverse = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                             3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    for (size_t c = 0; c < chunks; c++, input += 32) {
+        __m256i bytes = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)input), reverse);
+        __m256i low = _mm256_slli_epi16(bytes, 4);
+        __m256i first = _mm256_unpacklo_epi8(low, bytes), second = _mm256_unpackhi_epi8(low, bytes);
+        __m256i front = _mm256_permute2x128_si256(first, second, 0x20);
+        __m256i back = _mm256_permute2x128_si256(first, second, 0x31);
+        uint64_t planes[4];
+        for (int d = 0; d < 4; d++) {
+            planes[d] = (uint64_t)(uint32_t)_mm256_movemask_epi8(front) | (uint64_t)(uint32_t)_mm256_movemask_epi8(back) << 32;
+            front = _mm256_add_epi8(front, front);
+            back = _mm256_add_epi8(back, back);
+        }
+        storeSlices(planes[0], planes[1], planes[2], planes[3], parts, 8 * c);
+    }
+}
+#endif
 
-    // Set the last character as null-terminator
-    hamming74[7] = '\0';
+// Slicing kernel for this processor, set by pickSliceKernel (NULL: the table does every byte)
+void (*sliceKernel)(const unsigned char *input, size_t chunks, unsigned char **parts) = NULL;
 
-    // Copy the Hamming(7,4) data to the output parameter
-    strcpy(encodedData, hamming74);
+// Function to pick the widest slicing kernel the processor supports (CPUID)
+void pickSliceKernel(void) {
+#ifdef STRIPE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        sliceKernel = sliceAvx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        sliceKernel = sliceSse2;
+    }
+#endif
 }
 
+// Function to encode a block: every 4 input bytes (8 nibbles) become one byte of each part, 32 bytes at a
+// time through the slicing kernel if there is one and the rest through the table; the codeword of nibble
+// 0 is all zeros, so padding the input with zero bytes pads the parts with zero bits.
+// 'input' needs 3 bytes of room past 'length'; returns the bytes written to each part
+size_t stripeBlock(unsigned char *input, size_t length, unsigned char **parts) {
+    memset(input + length, 0, 3);
+    size_t partBytes = (length + 3) / 4;
+    size_t sliced = 0;
+    if (sliceKernel != NULL) {
+        sliceKernel(input, partBytes / 8, parts);
+        sliced = partBytes / 8 * 8;
+    }
+    for (size_t i = sliced; i < partBytes; i++) {
+        const unsigned char *in = input + 4 * i;
+        uint64_t bytes = partPairs[in[0]] << 6 | partPairs[in[1]] << 4 | partPairs[in[2]] << 2 | partPairs[in[3]];
+        for (int k = 0; k < PARTS; k++) {
+            parts[k][i] = (unsigned char)(bytes >> (8 * k));
+        }
+    }
+    return partBytes;
+}
 
-// Function to convert a character to its hexadecimal representation
-void charToHex(char c, char* hex) {
-    snprintf(hex, 3, "%02X", c);
+// Function to write part bytes as hex text, 'column' carries the position in the line between calls
+int writeHexText(FILE *outputFile, const unsigned char *bytes, size_t count, int *column) {
+    for (size_t i = 0; i < count; i++) {
+        fputc("0123456789ABCDEF"[bytes[i] >> 4], outputFile);
+        fputc("0123456789ABCDEF"[bytes[i] & 15], outputFile);
+        *column += 2;
+        if (*column == TEXT_LINE_DIGITS) {
+            fputc('\n', outputFile);
+            *column = 0;
+        }
+    }
+    return ferror(outputFile) ? -1 : 0;
 }
 
-// Function to convert a hexadecimal character to binary
-void hexToBinary(char hex, char* binary) {
-    switch (hex) {
-        case '0':
-            strcpy(binary, "0000");
-            break;
-        case '1':
-            strcpy(binary, "0001");
-            break;
-        case '2':
-            strcpy(binary, "0010");
-            break;
-        case '3':
-            strcpy(binary, "0011");
-            break;
-        case '4':
-            strcpy(binary, "0100");
-            break;
-        case '5':
-            strcpy(binary, "0101");
-            break;
-        case '6':
-            strcpy(binary, "0110");
-            break;
-        case '7':
-            strcpy(binary, "0111");
-            break;
-        case '8':
-            strcpy(binary, "1000");
-            break;
-        case '9':
-            strcpy(binary, "1001");
-            break;
-        case 'A':
-        case 'a':
-            strcpy(binary, "1010");
-            break;
-        case 'B':
-        case 'b':
-            strcpy(binary, "1011");
-            break;
-        case 'C':
-        case 'c':
-            strcpy(binary, "1100");
-            break;
-        case 'D':
-        case 'd':
-            strcpy(binary, "1101");
-            break;
-        case 'E':
-        case 'e':
-            strcpy(binary, "1110");
-            break;
-        case 'F':
-        case 'f':
-            strcpy(binary, "1111");
+// Struct for one queued write of a part: a block of part data and where it goes
+struct PartWrite {
+    const unsigned char *data;
+    size_t length;
+    uint64_t offset;
+    int busy; // Submitted and not yet written
+};
+
+struct PartWriter;
+
+// Struct for the argument of one writer thread
+struct PartWriterThread {
+    struct PartWriter *writer;
+    int part;
+};
+
+// Struct for the part writer: the blocks of every part are written concurrently, through io_uring
+// where the kernel has it and otherwise by one thread per part. There are WRITE_BUFFERS sets of part
+// buffers, so the next block is encoded while the last one is written
+struct PartWriter {
+    int parts;
+    int fds[STRIPE_MAX_PARTS];
+    struct PartWrite writes[WRITE_BUFFERS][STRIPE_MAX_PARTS];
+    int pending[WRITE_BUFFERS];   // Writes of each buffer set not finished yet
+    int error;                    // errno of the first failed write, 0 if none
+    int uring;                    // 1 with io_uring, 0 with writer threads
+    // io_uring (raw system calls, the rings are mapped from the kernel)
+    int ringFd;
+    unsigned *sqTail, *sqMask, *sqArray, *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqRing, *cqRing;
+    size_t sqRingSize, cqRingSize, sqesSize;
+    unsigned toSubmit;            // Entries queued since the last io_uring_enter
+    // Writer threads
+    pthread_t threads[STRIPE_MAX_PARTS];
+    struct PartWriterThread threadArguments[STRIPE_MAX_PARTS];
+    int started;
+    int nextSet[STRIPE_MAX_PARTS]; // Buffer set each thread writes next
+    int stopping;
+    pthread_mutex_t lock;         // Protects writes, pending, error, nextSet and stopping
+    pthread_cond_t changed;
+};
+
+// Function to tell whether an io_uring supports IORING_OP_WRITE: both the opcode and the probe that reports
+// it came with kernel 5.6, so the rings of 5.1 to 5.5 fail the probe and are not used
+int uringCanWrite(int ringFd) {
+    size_t probeSize = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = (struct io_uring_probe *)calloc(1, probeSize);
+    int supported = probe != NULL && syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+                    probe->last_op >= IORING_OP_WRITE && (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return supported;
+}
+
+// Function to set up an io_uring for the part writes, returns -1 if the kernel has none (or refuses it,
+// or cannot write through it)
+int startUring(struct PartWriter *writer) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    writer->ringFd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (writer->ringFd < 0) {
+        return -1;
+    }
+    if (!uringCanWrite(writer->ringFd)) {
+        close(writer->ringFd);
+        return -1;
+    }
+    writer->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    writer->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (writer->cqRingSize > writer->sqRingSize) {
+            writer->sqRingSize = writer->cqRingSize;
+        }
+        writer->cqRingSize = 0;
+    }
+    writer->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    writer->sqRing = mmap(NULL, writer->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, writer->ringFd, IORING_OFF_SQ_RING);
+    writer->cqRing = writer->cqRingSize == 0 ? writer->sqRing
+                   : mmap(NULL, writer->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, writer->ringFd, IORING_OFF_CQ_RING);
+    writer->sqes = (struct io_uring_sqe *)mmap(NULL, writer->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                               writer->ringFd, IORING_OFF_SQES);
+    if (writer->sqRing == MAP_FAILED || writer->cqRing == MAP_FAILED || (void *)writer->sqes == MAP_FAILED) {
+        close(writer->ringFd); // The process exits soon after, so the mappings that worked are left alone
+        return -1;
+    }
+    char *sq = (char *)writer->sqRing, *cq = (char *)writer->cqRing;
+    writer->sqTail = (unsigned *)(sq + params.sq_off.tail);
+    writer->sqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    writer->sqArray = (unsigned *)(sq + params.sq_off.array);
+    writer->cqHead = (unsigned *)(cq + params.cq_off.head);
+    writer->cqTail = (unsigned *)(cq + params.cq_off.tail);
+    writer->cqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    writer->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    writer->toSubmit = 0;
+    return 0;
+}
+
+// Function to queue the io_uring write of what is left of one part's block (no more than
+// WRITE_BUFFERS * STRIPE_MAX_PARTS are in flight, so the ring never fills)
+void queueUringWrite(struct PartWriter *writer, int set, int part) {
+    const struct PartWrite *write = &writer->writes[set][part];
+    unsigned tail = *writer->sqTail, index = tail & *writer->sqMask;
+    struct io_uring_sqe *sqe = &writer->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = writer->fds[part];
+    sqe->addr = (uint64_t)(uintptr_t)write->data;
+    sqe->len = (unsigned)write->length;
+    sqe->off = write->offset;
+    sqe->user_data = (uint64_t)(set * STRIPE_MAX_PARTS + part);
+    writer->sqArray[index] = index;
+    __atomic_store_n(writer->sqTail, tail + 1, __ATOMIC_RELEASE);
+    writer->toSubmit++;
+}
+
+// Function to submit the queued writes and handle the finished ones, waiting for at least 'wait' of
+// them; a short write is queued again for the rest of its block
+int runUring(struct PartWriter *writer, unsigned wait) {
+    for (;;) {
+        long entered = syscall(__NR_io_uring_enter, writer->ringFd, writer->toSubmit, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0,
+                               NULL, 0);
+        if (entered >= 0) {
+            writer->toSubmit -= (unsigned)entered < writer->toSubmit ? (unsigned)entered : writer->toSubmit;
             break;
-        default:
-            strcpy(binary, "0000"); // Set to 0000 for non-hex characters
+        }
+        if (errno != EINTR) {
+            return -1;
+        }
+    }
+    unsigned head = *writer->cqHead, tail = __atomic_load_n(writer->cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        const struct io_uring_cqe *cqe = &writer->cqes[head & *writer->cqMask];
+        int set = (int)(cqe->user_data / STRIPE_MAX_PARTS), part = (int)(cqe->user_data % STRIPE_MAX_PARTS);
+        struct PartWrite *write = &writer->writes[set][part];
+        int result = cqe->res;
+        if (result == -EINTR || result == -EAGAIN) {
+            queueUringWrite(writer, set, part);
+            continue;
+        }
+        if (result > 0 && (size_t)result < write->length) {
+            write->data += result;
+            write->length -= (size_t)result;
+            write->offset += (uint64_t)result;
+            queueUringWrite(writer, set, part);
+            continue;
+        }
+        if (result < 0 || (result == 0 && write->length > 0)) {
+            writer->error = writer->error ? writer->error : (result < 0 ? -result : EIO);
+        }
+        write->busy = 0;
+        writer->pending[set]--;
     }
+    __atomic_store_n(writer->cqHead, head, __ATOMIC_RELEASE);
+    return 0;
 }
 
-// Function to convert a binary string to a hexadecimal character
-char binaryToHexChar(const char* binary) {
-    int decimal = 0;
-    for (int i = 0; i < 4; i++) {
-        decimal = decimal * 2 + (binary[i] - '0');
+// Function run by the writer thread of one part: writes its blocks in the order they are submitted
+void *partWriterThread(void *argument) {
+    struct PartWriter *writer = ((struct PartWriterThread *)argument)->writer;
+    int part = ((struct PartWriterThread *)argument)->part;
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        struct PartWrite *write = &writer->writes[writer->nextSet[part]][part];
+        if (!write->busy) {
+            if (writer->stopping) {
+                break;
+            }
+            pthread_cond_wait(&writer->changed, &writer->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&writer->lock);
+        int error = 0;
+        while (write->length > 0) {
+            ssize_t n = pwrite(writer->fds[part], write->data, write->length, (off_t)write->offset);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                error = n < 0 ? errno : EIO;
+                break;
+            }
+            write->data += n;
+            write->length -= (size_t)n;
+            write->offset += (uint64_t)n;
+        }
+        pthread_mutex_lock(&writer->lock);
+        writer->error = writer->error ? writer->error : error;
+        write->busy = 0;
+        writer->pending[writer->nextSet[part]]--;
+        writer->nextSet[part] = (writer->nextSet[part] + 1) % WRITE_BUFFERS;
+        pthread_cond_broadcast(&writer->changed);
     }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
 
-    if (decimal >= 0 && decimal <= 9) {
-        return '0' + decimal;
-    } else {
-        return 'A' + (decimal - 10);
+// Function to start the part writer on open part files, with io_uring unless 'threads' is set or the
+// kernel has none
+int startPartWriter(struct PartWriter *writer, const int *fds, int parts, int threads) {
+    memset(writer, 0, sizeof(*writer));
+    writer->parts = parts;
+    memcpy(writer->fds, fds, parts * sizeof(int));
+    if (!threads && startUring(writer) == 0) {
+        writer->uring = 1;
+        return 0;
+    }
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->changed, NULL);
+    for (; writer->started < parts; writer->started++) {
+        struct PartWriterThread *argument = &writer->threadArguments[writer->started];
+        argument->writer = writer;
+        argument->part = writer->started;
+        if (pthread_create(&writer->threads[writer->started], NULL, partWriterThread, argument) != 0) {
+            printf("Error: Cannot start the writer threads\n");
+            return -1;
+        }
     }
+    return 0;
 }
 
-int main(int argc, char *argv[]) {
-    if (argc != 3 || strcmp(argv[1], "-f") != 0) {
-        printf("Usage: %s -f <filename>\n", argv[0]);
-        return 1;
+// Function to write block 'set' of every part: 'length' bytes of parts[k] at 'offset' of part k. The
+// buffers must stay untouched until waitPartWrites returns for this set
+void submitPartWrites(struct PartWriter *writer, int set, unsigned char **parts, size_t length, uint64_t offset) {
+    if (!writer->uring) {
+        pthread_mutex_lock(&writer->lock);
+    }
+    for (int k = 0; k < writer->parts; k++) {
+        writer->writes[set][k] = (struct PartWrite){ parts[k], length, offset, 1 };
+        if (writer->uring) {
+            queueUringWrite(writer, set, k);
+        }
+    }
+    writer->pending[set] = writer->parts;
+    if (writer->uring) {
+        if (runUring(writer, 0) != 0 && writer->error == 0) {
+            writer->error = errno;
+        }
+        return;
     }
+    pthread_cond_broadcast(&writer->changed);
+    pthread_mutex_unlock(&writer->lock);
+}
 
-    // Open the file for reading
-    FILE *file = fopen(argv[2], "r");
-    if (file == NULL) {
-        perror("Error opening file");
-        return 1;
+// Function to wait until the writes of buffer set 'set' are done, returns -1 if any write so far failed
+int waitPartWrites(struct PartWriter *writer, int set) {
+    int error;
+    if (writer->uring) {
+        while (writer->pending[set] > 0) {
+            if (runUring(writer, 1) != 0) {
+                writer->error = writer->error ? writer->error : errno;
+                break;
+            }
+        }
+        error = writer->error;
+    } else {
+        pthread_mutex_lock(&writer->lock);
+        while (writer->pending[set] > 0) {
+            pthread_cond_wait(&writer->changed, &writer->lock);
+        }
+        error = writer->error;
+        pthread_mutex_unlock(&writer->lock);
     }
+    if (error != 0) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
 
-    // Open seven output files, one for each bit of the Hamming(7,4) code
-    FILE *outputFiles[7];
-    char filenames[7][100];
-    for (int i = 0; i < 7; i++) {
-        snprintf(filenames[i], sizeof(filenames[i]), "%s.part%d", argv[2], i);
-        outputFiles[i] = fopen(filenames[i], "w");
-        if (outputFiles[i] == NULL) {
-            perror("Error opening output file");
-            return 1;
+// Function to wait for every write and stop the part writer, returns -1 if any write failed
+int stopPartWriter(struct PartWriter *writer) {
+    int status = 0;
+    for (int set = 0; set < WRITE_BUFFERS; set++) {
+        if (waitPartWrites(writer, set) != 0) {
+            status = -1;
+        }
+    }
+    if (writer->uring) {
+        munmap(writer->sqes, writer->sqesSize);
+        if (writer->cqRing != writer->sqRing) {
+            munmap(writer->cqRing, writer->cqRingSize);
+        }
+        munmap(writer->sqRing, writer->sqRingSize);
+        close(writer->ringFd);
+    } else {
+        pthread_mutex_lock(&writer->lock);
+        writer->stopping = 1;
+        pthread_cond_broadcast(&writer->changed);
+        pthread_mutex_unlock(&writer->lock);
+        for (int k = 0; k < writer->started; k++) {
+            pthread_join(writer->threads[k], NULL);
         }
+        pthread_mutex_destroy(&writer->lock);
+        pthread_cond_destroy(&writer->changed);
+    }
+    if (status != 0) {
+        errno = writer->error;
     }
+    return status;
+}
 
-    char line[100]; // Adjust the size as needed
-    int currentOutputFileIndex = 0;
+// Function to set up the code to write with, 'parts' only counting for SECDED(72,64) and Reed-Solomon;
+// returns -1 after an error message for parts that do not fit the code
+int setupStripeCode(struct StripeCode *code, int number, int parts) {
+    memset(code, 0, sizeof(*code));
+    code->code = number;
+    if (number == STRIPE_CODE_HAMMING74) {
+        code->parts = PARTS;
+        code->blockSize = BLOCK_SIZE;
+        code->bufferSize = PARTS * PART_STRIDE;
+        return 0;
+    }
+    if (isReedSolomon(number)) {
+        int parity = number & 0x0F;
+        if (setupReedSolomon(&code->rs, parts - parity, parity) != 0) {
+            printf("Error: Reed-Solomon needs 1 to %d parity parts and at most %d parts in all\n", RS_MAX_PARITY, STRIPE_MAX_PARTS);
+            return -1;
+        }
+        unsigned char erased[STRIPE_MAX_PARTS] = { 0 };
+        memset(erased + parts - parity, 1, parity);
+        code->parts = parts;
+        code->blockSize = (size_t)code->rs.dataParts * LANE_BYTES;
+        code->bufferSize = (size_t)parts * LANE_BYTES;
+        return solveReedSolomon(&code->rs, erased, &code->rsParity);
+    }
+    setupLaneCode(&code->lanes, number);
+    code->parts = number == STRIPE_CODE_SECDED7264 ? parts : code->lanes.lanes;
+    if (code->parts < 1 || code->lanes.lanes % code->parts != 0) {
+        printf("Error: %d part files do not split %d lanes evenly\n", code->parts, code->lanes.lanes);
+        return -1;
+    }
+    code->blockSize = (size_t)code->lanes.dataLanes * LANE_BYTES;
+    code->bufferSize = (size_t)code->lanes.lanes * LANE_BYTES;
+    for (int b = 0; b < code->lanes.rows; b++) {
+        code->isParity[code->lanes.parityLanes[b]] = 1;
+    }
+    // The parity lanes are always independent, being one per check
+    return solveLaneErasures(&code->lanes, code->isParity, &code->parity);
+}
 
-    // Stores the hamming bits to be converted to hex
-    char buffer[7][100000]; // You can adjust the size as needed
-    int bufferIndex[7] = {0};
+// Function to encode a block of up to blockSize input bytes into the lanes of a lane code, all in
+// 'block' one after the other, and point 'parts' at every part's lanes; returns the bytes of every part
+size_t stripeLanes(const struct StripeCode *code, const unsigned char *input, size_t length, unsigned char *block,
+                   unsigned char **parts, uint64_t **checks) {
+    size_t laneBytes = blockLaneBytes(length, code->blockSize, code->lanes.dataLanes);
+    uint64_t *lanes[LANE_MAX];
+    for (int k = 0; k < code->lanes.lanes; k++) {
+        lanes[k] = (uint64_t *)(block + k * laneBytes);
+    }
+    // Data lane j is input bytes j * laneBytes on, the last ones padded with zeros
+    for (int j = 0; j < code->lanes.dataLanes; j++) {
+        size_t start = j * laneBytes, count = start < length ? length - start : 0;
+        count = count < laneBytes ? count : laneBytes;
+        unsigned char *lane = (unsigned char *)lanes[code->lanes.dataLane[j]];
+        memcpy(lane, input + start, count);
+        memset(lane + count, 0, laneBytes - count);
+    }
+    restoreLanes(&code->lanes, &code->parity, code->isParity, lanes, checks, laneBytes / 8);
+    size_t lanesPerPart = code->lanes.lanes / code->parts;
+    for (int k = 0; k < code->parts; k++) {
+        parts[k] = block + k * lanesPerPart * laneBytes;
+    }
+    return lanesPerPart * laneBytes;
+}
 
-    while (fgets(line, sizeof(line), file)) {
-        int dataLength = strlen(line) - 1; // Exclude the newline character
-        int numChunks = (dataLength + 3) / 4; // Calculate the number of 4-character chunks
+// Function to encode a block of up to blockSize input bytes into Reed-Solomon parts, all in 'block' one
+// after the other, and point 'parts' at them; returns the bytes of every part
+size_t stripeReedSolomon(const struct StripeCode *code, const unsigned char *input, size_t length, unsigned char *block,
+                         unsigned char **parts) {
+    size_t partBytes = blockLaneBytes(length, code->blockSize, code->rs.dataParts);
+    for (int k = 0; k < code->parts; k++) {
+        parts[k] = block + k * partBytes;
+    }
+    // Data part d is input bytes d * partBytes on, the last ones padded with zeros
+    for (int d = 0; d < code->rs.dataParts; d++) {
+        size_t start = d * partBytes, count = start < length ? length - start : 0;
+        count = count < partBytes ? count : partBytes;
+        memcpy(parts[d], input + start, count);
+        memset(parts[d] + count, 0, partBytes - count);
+    }
+    restoreReedSolomon(&code->rs, &code->rsParity, parts, partBytes);
+    return partBytes;
+}
 
-        for (int i = 0; i < numChunks; i++) {
-            char chunk[5]; // Reserve space for 4 characters and the null terminator
-            strncpy(chunk, line + i * 4, 4); // Copy 4 characters from the line into the chunk
-            chunk[4] = '\0'; // Null-terminate the chunk
+// Function to write every part's header and, after the data, its checksums: the header goes in first
+// with zero sizes (checksums NULL) and is written again with the final sizes
+int writeStripeHeaders(const int *fds, const struct StripeCode *code, uint64_t originalSize, uint32_t blockCount, uint64_t partBytes,
+                       uint32_t **checksums) {
+    struct StripeHeader header = { STRIPE_VERSION, 0, code->parts, code->code, originalSize, (uint32_t)code->blockSize, blockCount,
+                                   partBytes };
+    unsigned char *table = (unsigned char *)malloc(4 * (size_t)blockCount + 1);
+    if (table == NULL) {
+        return -1;
+    }
+    int status = 0;
+    for (int k = 0; k < code->parts && status == 0; k++) {
+        unsigned char bytes[STRIPE_HEADER_SIZE];
+        header.part = k;
+        formatStripeHeader(bytes, &header);
+        for (uint32_t b = 0; checksums != NULL && b < blockCount; b++) {
+            putLittleEndian(table + 4 * b, checksums[k][b], 4);
+        }
+        if ((checksums != NULL && writeAt(fds[k], table, 4 * (size_t)blockCount, STRIPE_HEADER_SIZE + header.part_bytes) != 0) ||
+            writeAt(fds[k], bytes, STRIPE_HEADER_SIZE, 0) != 0) {
+            status = -1;
+        }
+    }
+    free(table);
+    return status;
+}
 
-        //    printf("Original Data Chunk: %s\n", chunk);
+// Function to stripe the input into hex text parts (-t) one block at a time
+int encodeTextStripes(FILE *file, FILE **outputFiles) {
+    unsigned char *input = (unsigned char *)malloc(BLOCK_SIZE + 3);
+    unsigned char *parts[PARTS];
+    int columns[PARTS] = { 0 };
+    for (int k = 0; k < PARTS; k++) {
+        parts[k] = (unsigned char *)malloc(BLOCK_SIZE / 4 + 1);
+        if (parts[k] == NULL) {
+            input = NULL;
+        }
+    }
+    if (input == NULL) {
+        printf("Error: Out of memory\n");
+        return 1;
+    }
 
-            // Convert and print the original data chunk to hex
-            char hex[9]; // Reserve space for 8 characters and the null terminator
-            hex[0] = '\0'; // Initialize hex as an empty string
-            for (int j = 0; j < 4; j++) {
-                char hexChar[3];
-                charToHex(chunk[j], hexChar);
-                strcat(hex, hexChar);
-            }
-        //    printf("Hexadecimal Representation: %s\n", hex);
-
-            // Convert and print the hexadecimal representation to binary
-            // printf("Binary Representation: ");
-            for (int j = 0; j < 8; j++) {
-                char binary[5];
-                hexToBinary(hex[j], binary);
-            //    printf("Binary Representation: %s \n", binary);
-                
-                // Encode the 4-digit binary chunk as Hamming(7,4)
-                char hamming74[8]; // To store the Hamming(7,4) encoded data
-                encodeHamming74(binary, 4, hamming74);
-
-            //    printf("Hamming(7,4) Encoded Data: %s\n", hamming74);
-
-                for (int k = 0; k < 7; k++) {
-                    buffer[k][bufferIndex[k]] = hamming74[k];
-                    bufferIndex[k]++;
-                }
-        
+    size_t bytesRead;
+    while ((bytesRead = fread(input, 1, BLOCK_SIZE, file)) > 0) {
+        size_t partBytes = stripeBlock(input, bytesRead, parts);
+        for (int k = 0; k < PARTS; k++) {
+            if (writeHexText(outputFiles[k], parts[k], partBytes, &columns[k]) != 0) {
+                perror("Error writing output file");
+                return 1;
             }
+        }
+    }
+    if (ferror(file)) {
+        perror("Error reading file");
+        return 1;
+    }
+    for (int k = 0; k < PARTS; k++) {
+        if (columns[k] > 0) {
+            fputc('\n', outputFiles[k]);
+        }
+        free(parts[k]);
+    }
+    free(input);
+    return 0;
+}
 
+// Function to stripe any input into the part files one block at a time: nothing depends on lines or on
+// the input size, so memory stays at one input block and WRITE_BUFFERS blocks of each part (plus 4
+// bytes of checksum per block and part). A block is encoded while the one before is being written
+int encodeStripes(FILE *file, const int *fds, const struct StripeCode *code, int threads) {
+    unsigned char *input = (unsigned char *)malloc(code->blockSize + 3);
+    unsigned char *blocks[WRITE_BUFFERS], *parts[WRITE_BUFFERS][STRIPE_MAX_PARTS];
+    uint32_t *checksums[STRIPE_MAX_PARTS] = { NULL };
+    uint32_t blockCount = 0, checksumCapacity = 0;
+    uint64_t originalSize = 0, partOffset = 0;
+    static uint64_t checkWords[LANE_MAX_ROWS][LANE_STRIP_WORDS];
+    uint64_t *checks[LANE_MAX_ROWS];
+    for (int b = 0; b < LANE_MAX_ROWS; b++) {
+        checks[b] = checkWords[b];
+    }
+    for (int set = 0; set < WRITE_BUFFERS; set++) {
+        // Page aligned, for the kernel's sake
+        if (posix_memalign((void **)&blocks[set], 4096, code->bufferSize) != 0) {
+            input = NULL;
         }
-            // Print the contents of the buffer matrix
-            for (int i = 0; i < 7; i++) {
-            //    printf("Hamming(7,4) Bit %d: ", i);
-                for (int j = 0; j < bufferIndex[i]; j++) {
-                //    printf("%c ", buffer[i][j]);
+    }
+    if (input == NULL) {
+        printf("Error: Out of memory\n");
+        return 1;
+    }
+
+    struct PartWriter writer;
+    if (writeStripeHeaders(fds, code, 0, 0, 0, NULL) != 0) {
+        perror("Error writing output file");
+        return 1;
+    }
+    if (startPartWriter(&writer, fds, code->parts, threads) != 0) {
+        return 1;
+    }
+
+    // The block size is a multiple of 4 and of 8 bytes per data lane, so only the last block can end
+    // inside a part byte or lane word
+    size_t bytesRead;
+    int set = 0, status = 0;
+    while ((bytesRead = fread(input, 1, code->blockSize, file)) > 0) {
+        if (waitPartWrites(&writer, set) != 0) {
+            perror("Error writing output file");
+            status = 1;
+            break;
+        }
+        size_t partBytes;
+        if (code->code == STRIPE_CODE_HAMMING74) {
+            for (int k = 0; k < PARTS; k++) {
+                parts[set][k] = blocks[set] + k * PART_STRIDE;
+            }
+            partBytes = stripeBlock(input, bytesRead, parts[set]);
+        } else if (isReedSolomon(code->code)) {
+            partBytes = stripeReedSolomon(code, input, bytesRead, blocks[set], parts[set]);
+        } else {
+            partBytes = stripeLanes(code, input, bytesRead, blocks[set], parts[set], checks);
+        }
+        if (blockCount == checksumCapacity) {
+            checksumCapacity = checksumCapacity ? checksumCapacity * 2 : 64;
+            for (int k = 0; k < code->parts; k++) {
+                checksums[k] = (uint32_t *)realloc(checksums[k], checksumCapacity * sizeof(uint32_t));
+                if (checksums[k] == NULL) {
+                    printf("Error: Out of memory\n");
+                    return 1;
                 }
-            //    printf("\n");
             }
-            // Convert and print each row of the buffer matrix to hex
-            for (int i = 0; i < 7; i++) {
-            //    printf("Hamming(7,4) Bit %d (Hexadecimal): ", i);
+        }
+        for (int k = 0; k < code->parts; k++) {
+            checksums[k][blockCount] = crc32(parts[set][k], partBytes);
+        }
+        submitPartWrites(&writer, set, parts[set], partBytes, STRIPE_HEADER_SIZE + partOffset);
+        blockCount++;
+        originalSize += bytesRead;
+        partOffset += partBytes;
+        set = (set + 1) % WRITE_BUFFERS;
+    }
+    if (stopPartWriter(&writer) != 0 && status == 0) {
+        perror("Error writing output file");
+        status = 1;
+    }
+    if (status == 0 && ferror(file)) {
+        perror("Error reading file");
+        status = 1;
+    }
+    if (status == 0 && writeStripeHeaders(fds, code, originalSize, blockCount, partOffset, checksums) != 0) {
+        perror("Error writing output file");
+        status = 1;
+    }
 
-                for (int j = 0; j < bufferIndex[i]; j += 4) {
-                    char binaryChunk[5]; // To store the binary chunk
-                    strncpy(binaryChunk, buffer[i] + j, 4); // Extract a 4-bit chunk
-                    binaryChunk[4] = '\0'; // Null-terminate the chunk
+    for (set = 0; set < WRITE_BUFFERS; set++) {
+        free(blocks[set]);
+    }
+    for (int k = 0; k < code->parts; k++) {
+        free(checksums[k]);
+    }
+    free(input);
+    return status;
+}
 
-                    char hex = binaryToHexChar(binaryChunk);
-                //    printf("%c ", hex);
+int main(int argc, char *argv[]) {
+    char *filename = NULL;
+    int text = 0, threads = 0, codeNumber = STRIPE_CODE_HAMMING74, parts = SECDED_PARTS;
+    int dataParts = RS_DATA_PARTS, parityParts = RS_PARITY_PARTS;
+    int partsGiven = 0, reedSolomonGiven = 0; // -n, and -k or -m, which only some codes take
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            filename = argv[++i];
+        } else if (strcmp(argv[i], "-t") == 0) {
+            text = 1;
+        } else if (strcmp(argv[i], "-w") == 0) {
+            threads = 1;
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            i++;
+            codeNumber = strcmp(argv[i], "74") == 0     ? STRIPE_CODE_HAMMING74
+                         : strcmp(argv[i], "1511") == 0 ? STRIPE_CODE_HAMMING1511
+                         : strcmp(argv[i], "7264") == 0 ? STRIPE_CODE_SECDED7264
+                         : strcmp(argv[i], "rs") == 0   ? STRIPE_CODE_REED_SOLOMON
+                                                        : 0;
+            if (codeNumber == 0) {
+                filename = NULL;
+                break;
+            }
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            parts = atoi(argv[++i]);
+            partsGiven = 1;
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            dataParts = atoi(argv[++i]);
+            reedSolomonGiven = 1;
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            parityParts = atoi(argv[++i]);
+            reedSolomonGiven = 1;
+        } else {
+            filename = NULL;
+            break;
+        }
+    }
+    if (filename == NULL || (text && codeNumber != STRIPE_CODE_HAMMING74) || (partsGiven && codeNumber != STRIPE_CODE_SECDED7264) ||
+        (reedSolomonGiven && codeNumber != STRIPE_CODE_REED_SOLOMON)) {
+        printf("Usage: %s -f <filename> [-t] [-w] [-c 74|1511|7264|rs] [-n <parts>] [-k <data parts>] [-m <parity parts>]\n", argv[0]);
+        printf("       -t writes the parts as hex text instead of packed bits (Hamming(7,4) only)\n");
+        printf("       -w writes the parts with one thread each instead of io_uring\n");
+        printf("       -c picks the code: Hamming(7,4) in 7 parts (the default), Hamming(15,11) in 15\n");
+        printf("          parts, or SECDED(72,64) in 72 lanes split over -n parts (default %d)\n", SECDED_PARTS);
+        printf("       -c rs writes -k data parts and -m Reed-Solomon parity parts (default %d and %d), any -m\n", RS_DATA_PARTS,
+               RS_PARITY_PARTS);
+        printf("          of which can be lost\n");
+        return 1;
+    }
+    buildGfTables();
+    pickGfKernel();
+    struct StripeCode code;
+    if (codeNumber == STRIPE_CODE_REED_SOLOMON) {
+        if (parityParts < 1 || parityParts > RS_MAX_PARITY) {
+            printf("Error: Reed-Solomon needs 1 to %d parity parts\n", RS_MAX_PARITY);
+            return 1;
+        }
+        codeNumber |= parityParts;
+        parts = dataParts + parityParts;
+    }
+    if (setupStripeCode(&code, codeNumber, parts) != 0) {
+        return 1;
+    }
 
-                    // Write the hex character to the corresponding output file
-                    fputc(hex, outputFiles[i]);
-                }
-                // Make sure to add a newline character at the end of the row in the output file
-                fputc('\n', outputFiles[i]);
+    // Open the file for reading
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        perror("Error opening file");
+        return 1;
+    }
 
-            //    printf("\n");
-            }
-        currentOutputFileIndex = (currentOutputFileIndex + 1) % 7;
+    // Open the output files, one for each bit of the Hamming(7,4) code or group of lanes: hex text goes
+    // through stdio with a large buffer, binary parts are written by the part writer
+    FILE *outputFiles[PARTS];
+    int fds[STRIPE_MAX_PARTS];
+    for (int i = 0; i < code.parts; i++) {
+        char partFilename[4096];
+        snprintf(partFilename, sizeof(partFilename), "%s.part%d", filename, i);
+        if (text) {
+            outputFiles[i] = fopen(partFilename, "wb");
+        } else {
+            fds[i] = open(partFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
+        if (text ? outputFiles[i] == NULL : fds[i] < 0) {
+            perror("Error opening output file");
+            return 1;
+        }
+        if (text) {
+            setvbuf(outputFiles[i], NULL, _IOFBF, OUTPUT_BUFFER_SIZE);
+        }
     }
 
+    buildHammingTables();
+    buildCrcTables();
+    pickSliceKernel();
+    int status = text ? encodeTextStripes(file, outputFiles) : encodeStripes(file, fds, &code, threads);
+
     // Close all output files
-    for (int i = 0; i < 7; i++) {
-        fclose(outputFiles[i]);
+    for (int i = 0; i < code.parts; i++) {
+        if ((text ? fclose(outputFiles[i]) : close(fds[i])) != 0) {
+            perror("Error writing output file");
+            status = 1;
+        }
     }
-    
+
     fclose(file);
-    return 0;
-}
\ No newline at end of file
+    return status;
+}
@@ -0,0 +1,241 @@
+#ifndef REEDSOLOMON_H
+#define REEDSOLOMON_H
+
+#include <stdint.h>
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GF_X86 1 // SSSE3 and AVX2 multiply kernels, picked at run time
+#endif
+
+// Reed-Solomon erasure code shared by raid.c and diar.c: k data parts and m parity parts over GF(256)
+// (polynomial x^8 + x^4 + x^3 + x^2 + 1). The data parts hold the input as it is, one run of bytes each
+// per block (the layout of the lane codes in lanecode.h, one lane per part); parity byte i of part k + j
+// is the sum over the data parts d of parity[j][d] times byte i of part d. The parity rows form a Cauchy
+// matrix, so every k by k matrix of rows of [identity; parity] can be inverted and any k parts restore
+// the other m.
+
+#define RS_MAX_PARITY 15 // Most parity parts, stored in the low bits of the stripe code
+
+// Exponent and logarithm tables (gfExp is doubled so sums of two logarithms need no reduction), the
+// product of every pair of elements, and for every element its products with the 16 low nibbles and the
+// 16 high nibbles, for the split-nibble shuffle kernels
+static unsigned char gfExp[512], gfLog[256];
+static unsigned char gfMul[256][256];
+static unsigned char gfNibbles[256][32];
+
+// Struct for the parity rows of a Reed-Solomon code
+struct ReedSolomon {
+    int dataParts;
+    int parityParts;
+    unsigned char parity[RS_MAX_PARITY][STRIPE_MAX_PARTS];
+};
+
+// Struct for how to restore a set of erased parts: erased data part d is the sum over c of
+// inverse[d][c] times part sources[c]; erased parity parts are encoded again from the data parts
+struct ReedSolomonErasures {
+    int valid;                                        // 1 once solved for 'erased'
+    unsigned char erased[STRIPE_MAX_PARTS];
+    unsigned char sources[STRIPE_MAX_PARTS];
+    unsigned char inverse[STRIPE_MAX_PARTS][STRIPE_MAX_PARTS];
+};
+
+// Function to tell whether a stripe code is Reed-Solomon, the parity parts being code & 0x0F
+static inline int isReedSolomon(int code) {
+    return (code & 0xF0) == STRIPE_CODE_REED_SOLOMON;
+}
+
+// Function to fill the GF(256) tables
+static inline void buildGfTables(void) {
+    int value = 1;
+    for (int i = 0; i < 255; i++) {
+        gfExp[i] = gfExp[i + 255] = (unsigned char)value;
+        gfLog[value] = (unsigned char)i;
+        value <<= 1;
+        if (value & 0x100) {
+            value ^= 0x11D;
+        }
+    }
+    for (int a = 0; a < 256; a++) {
+        for (int b = 0; b < 256; b++) {
+            gfMul[a][b] = a == 0 || b == 0 ? 0 : gfExp[gfLog[a] + gfLog[b]];
+        }
+        for (int n = 0; n < 16; n++) {
+            gfNibbles[a][n] = gfMul[a][n];
+            gfNibbles[a][16 + n] = gfMul[a][n << 4];
+        }
+    }
+}
+
+// Function to give the inverse of a nonzero element
+static inline unsigned char gfInverse(unsigned char a) {
+    return gfExp[255 - gfLog[a]];
+}
+
+// Function to add 'coefficient' times every byte of 'source' to 'target', one table row lookup per byte
+static void gfMultiplyAddTable(unsigned char coefficient, const unsigned char *source, unsigned char *target, size_t length) {
+    const unsigned char *row = gfMul[coefficient];
+    for (size_t i = 0; i < length; i++) {
+        target[i] ^= row[source[i]];
+    }
+}
+
+#ifdef GF_X86
+// Function to multiply-add 16 bytes at a time with SSSE3: the product of a byte is the XOR of the products
+// of its two nibbles, each looked up in a 16-entry table with one shuffle
+__attribute__((target("ssse3"))) static void gfMultiplyAddSsse3(unsigned char coefficient, const unsigned char *source,
+                                                                 unsigned char *target, size_t length) {
+    const __m128i low = _mm_loadu_si128((const __m128i *)gfNibbles[coefficient]);
+    const __m128i high = _mm_loadu_si128((const __m128i *)(gfNibbles[coefficient] + 16));
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(source + i));
+        __m128i product = _mm_xor_si128(_mm_shuffle_epi8(low, _mm_and_si128(bytes, mask)),
+                                        _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi64(bytes, 4), mask)));
+        _mm_storeu_si128((__m128i *)(target + i), _mm_xor_si128(_mm_loadu_si128((const __m128i *)(target + i)), product));
+    }
+    gfMultiplyAddTable(coefficient, source + i, target + i, length - i);
+}
+
+// Function to multiply-add with AVX2, as gfMultiplyAddSsse3 with 32 bytes at a time
+__attribute__((target("avx2"))) static void gfMultiplyAddAvx2(unsigned char coefficient, const unsigned char *source,
+                                                               unsigned char *target, size_t length) {
+    const __m256i low = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)gfNibbles[coefficient]));
+    const __m256i high = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(gfNibbles[coefficient] + 16)));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(source + i));
+        __m256i product = _mm256_xor_si256(_mm256_shuffle_epi8(low, _mm256_and_si256(bytes, mask)),
+                                           _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi64(bytes, 4), mask)));
+        _mm256_storeu_si256((__m256i *)(target + i), _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(target + i)), product));
+    }
+    gfMultiplyAddTable(coefficient, source + i, target + i, length - i);
+}
+#endif
+
+// Multiply-add kernel for this processor, set by pickGfKernel
+static void (*gfMultiplyAddKernel)(unsigned char coefficient, const unsigned char *source, unsigned char *target,
+                                   size_t length) = gfMultiplyAddTable;
+
+// Function to pick the widest multiply-add kernel the processor supports (CPUID)
+static inline void pickGfKernel(void) {
+#ifdef GF_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        gfMultiplyAddKernel = gfMultiplyAddAvx2;
+    } else if (__builtin_cpu_supports("ssse3")) {
+        gfMultiplyAddKernel = gfMultiplyAddSsse3;
+    }
+#endif
+}
+
+// Function to add 'coefficient' times 'source' to 'target' (nothing for 0)
+static inline void gfMultiplyAdd(unsigned char coefficient, const unsigned char *source, unsigned char *target, size_t length) {
+    if (coefficient == 0) {
+        return;
+    }
+    gfMultiplyAddKernel(coefficient, source, target, length);
+}
+
+// Function to set up the parity rows of a code with 'dataParts' and 'parityParts' parts: row j, column d
+// is 1 / (x_j + y_d) with x_j = k + j and y_d = d, all distinct. Returns -1 for too many parts
+static inline int setupReedSolomon(struct ReedSolomon *code, int dataParts, int parityParts) {
+    if (dataParts < 1 || parityParts < 1 || parityParts > RS_MAX_PARITY || dataParts + parityParts > STRIPE_MAX_PARTS) {
+        return -1;
+    }
+    code->dataParts = dataParts;
+    code->parityParts = parityParts;
+    for (int j = 0; j < parityParts; j++) {
+        for (int d = 0; d < dataParts; d++) {
+            code->parity[j][d] = gfInverse((unsigned char)((dataParts + j) ^ d));
+        }
+    }
+    return 0;
+}
+
+// Function to work out how to restore the erased parts ('erased' has a nonzero byte for each): the rows of
+// the first k parts that are left are inverted by Gauss-Jordan elimination over GF(256). A solution for
+// the same erasures is kept. Returns -1 if more than m parts are erased
+static inline int solveReedSolomon(const struct ReedSolomon *code, const unsigned char *erased, struct ReedSolomonErasures *solution) {
+    int k = code->dataParts, parts = k + code->parityParts;
+    if (solution->valid && memcmp(solution->erased, erased, parts) == 0) {
+        return 0;
+    }
+    solution->valid = 0;
+    int count = 0;
+    for (int p = 0; p < parts && count < k; p++) {
+        if (!erased[p]) {
+            solution->sources[count++] = (unsigned char)p;
+        }
+    }
+    if (count < k) {
+        return -1;
+    }
+    // Row c of the system is the row of part sources[c], with the identity beside it
+    unsigned char system[STRIPE_MAX_PARTS][2 * STRIPE_MAX_PARTS];
+    for (int c = 0; c < k; c++) {
+        int p = solution->sources[c];
+        for (int d = 0; d < k; d++) {
+            system[c][d] = p < k ? p == d : code->parity[p - k][d];
+            system[c][k + d] = c == d;
+        }
+    }
+    for (int d = 0; d < k; d++) {
+        int pivot = d;
+        while (system[pivot][d] == 0) {
+            pivot++; // Always found: the rows are independent
+        }
+        if (pivot != d) {
+            for (int e = 0; e < 2 * k; e++) {
+                unsigned char swap = system[pivot][e];
+                system[pivot][e] = system[d][e];
+                system[d][e] = swap;
+            }
+        }
+        const unsigned char *scale = gfMul[gfInverse(system[d][d])];
+        for (int e = 0; e < 2 * k; e++) {
+            system[d][e] = scale[system[d][e]];
+        }
+        for (int c = 0; c < k; c++) {
+            if (c != d && system[c][d] != 0) {
+                const unsigned char *factor = gfMul[system[c][d]];
+                for (int e = 0; e < 2 * k; e++) {
+                    system[c][e] ^= factor[system[d][e]];
+                }
+            }
+        }
+    }
+    for (int d = 0; d < k; d++) {
+        memcpy(solution->inverse[d], system[d] + k, k);
+    }
+    memcpy(solution->erased, erased, parts);
+    solution->valid = 1;
+    return 0;
+}
+
+// Function to restore the erased parts of 'length' bytes from the others, the data parts first so the
+// parity parts can be encoded from them. Encoding is restoring the parity parts
+static inline void restoreReedSolomon(const struct ReedSolomon *code, const struct ReedSolomonErasures *solution,
+                                      unsigned char *const *parts, size_t length) {
+    int k = code->dataParts;
+    for (int d = 0; d < k; d++) {
+        if (solution->erased[d]) {
+            memset(parts[d], 0, length);
+            for (int c = 0; c < k; c++) {
+                gfMultiplyAdd(solution->inverse[d][c], parts[solution->sources[c]], parts[d], length);
+            }
+        }
+    }
+    for (int j = 0; j < code->parityParts; j++) {
+        if (solution->erased[k + j]) {
+            memset(parts[k + j], 0, length);
+            for (int d = 0; d < k; d++) {
+                gfMultiplyAdd(code->parity[j][d], parts[d], parts[k + j], length);
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef STRIPE_H
+#define STRIPE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+// Stripe header shared by raid.c (which writes it) and diar.c (which reads it)
+
+#define STRIPE_MAGIC "HSTR" // First bytes of a binary part file
+#define STRIPE_VERSION 1 // Part file layout written by raid.c
+#define STRIPE_HEADER_SIZE 32 // Bytes before the data of a part
+#define STRIPE_CODE_HAMMING74 1 // Hamming(7,4), one part per codeword bit
+#define STRIPE_CODE_HAMMING1511 2 // Hamming(15,11) in lanes (lanecode.h), one part per lane
+#define STRIPE_CODE_SECDED7264 3 // SECDED(72,64) in lanes (lanecode.h), the 72 lanes split evenly over the parts
+#define STRIPE_CODE_REED_SOLOMON 0x10 // Reed-Solomon over GF(256) (reedsolomon.h), parity parts in the low 4 bits
+#define STRIPE_MAX_PARTS 72 // Most part files of a stripe set
+
+// Part file layout (all integers little endian):
+//   header:    magic "HSTR", u8 version, u8 part index, u8 part count, u8 code, u64 original size in
+//              bytes, u32 block size (input bytes per block), u32 block count, u64 data bytes of
+//              the part
+//   data:      Hamming(7,4): the packed codeword bits of the part, block b from data byte
+//              b * block size / 4 on (the block size is a multiple of 4)
+//              lane codes: block b holds the part's lanes one after the other, each block size /
+//              data lanes bytes (the block size is a multiple of 8 * data lanes), except in the last
+//              block where every lane is just long enough for the rest of the input in whole words
+//              Reed-Solomon: as a lane code with one lane per part, the data parts being the data lanes
+//   checksums: one u32 CRC-32 of the data bytes of every block of the part
+// raid.c fills in the sizes when the part is complete; a part whose sizes do not add up to its file
+// size is not used.
+
+// Struct for the header of one part file
+struct StripeHeader {
+    int version;
+    int part;
+    int parts;
+    int code;
+    uint64_t original_size;
+    uint32_t block_size;
+    uint32_t block_count;
+    uint64_t part_bytes;
+};
+
+// CRC-32 (IEEE, reflected) tables for 8 bytes per step: table k gives the CRC of a byte followed by k zeros
+static uint32_t crcTables[8][256];
+
+// Function to fill the CRC-32 tables
+static inline void buildCrcTables(void) {
+    for (int byte = 0; byte < 256; byte++) {
+        uint32_t crc = (uint32_t)byte;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+        crcTables[0][byte] = crc;
+    }
+    for (int byte = 0; byte < 256; byte++) {
+        for (int k = 1; k < 8; k++) {
+            crcTables[k][byte] = (crcTables[k - 1][byte] >> 8) ^ crcTables[0][crcTables[k - 1][byte] & 0xFF];
+        }
+    }
+}
+
+// Function to compute the CRC-32 of a buffer
+static inline uint32_t crc32(const unsigned char *data, size_t length) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint32_t low = crc ^ ((uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24);
+        crc = crcTables[7][low & 0xFF] ^ crcTables[6][(low >> 8) & 0xFF] ^ crcTables[5][(low >> 16) & 0xFF] ^
+              crcTables[4][low >> 24] ^ crcTables[3][data[4]] ^ crcTables[2][data[5]] ^ crcTables[1][data[6]] ^
+              crcTables[0][data[7]];
+    }
+    for (; length > 0; data++, length--) {
+        crc = (crc >> 8) ^ crcTables[0][(crc ^ *data) & 0xFF];
+    }
+    return ~crc;
+}
+
+// Function to store a little endian value of 'size' bytes
+static inline void putLittleEndian(unsigned char *bytes, uint64_t value, int size) {
+    for (int i = 0; i < size; i++) {
+        bytes[i] = (unsigned char)(value >> (8 * i));
+    }
+}
+
+// Function to load a little endian value of 'size' bytes
+static inline uint64_t getLittleEndian(const unsigned char *bytes, int size) {
+    uint64_t value = 0;
+    for (int i = size - 1; i >= 0; i--) {
+        value = value << 8 | bytes[i];
+    }
+    return value;
+}
+
+// Function to lay a header out as the first STRIPE_HEADER_SIZE bytes of a part
+static inline void formatStripeHeader(unsigned char *bytes, const struct StripeHeader *header) {
+    memcpy(bytes, STRIPE_MAGIC, 4);
+    bytes[4] = (unsigned char)header->version;
+    bytes[5] = (unsigned char)header->part;
+    bytes[6] = (unsigned char)header->parts;
+    bytes[7] = (unsigned char)header->code;
+    putLittleEndian(bytes + 8, header->original_size, 8);
+    putLittleEndian(bytes + 16, header->block_size, 4);
+    putLittleEndian(bytes + 20, header->block_count, 4);
+    putLittleEndian(bytes + 24, header->part_bytes, 8);
+}
+
+// Function to read a header from the first STRIPE_HEADER_SIZE bytes of a part, returns -1 without the magic
+static inline int parseStripeHeader(const unsigned char *bytes, struct StripeHeader *header) {
+    if (memcmp(bytes, STRIPE_MAGIC, 4) != 0) {
+        return -1;
+    }
+    header->version = bytes[4];
+    header->part = bytes[5];
+    header->parts = bytes[6];
+    header->code = bytes[7];
+    header->original_size = getLittleEndian(bytes + 8, 8);
+    header->block_size = (uint32_t)getLittleEndian(bytes + 16, 4);
+    header->block_count = (uint32_t)getLittleEndian(bytes + 20, 4);
+    header->part_bytes = getLittleEndian(bytes + 24, 8);
+    return 0;
+}
+
+// Function to read 'count' bytes at 'offset', returns the bytes read (fewer only at the end of the file)
+static inline size_t readAt(int fd, unsigned char *buffer, size_t count, uint64_t offset) {
+    size_t done = 0;
+    while (done < count) {
+        ssize_t n = pread(fd, buffer + done, count - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        done += (size_t)n;
+    }
+    return done;
+}
+
+// Function to write 'count' bytes at 'offset', returns -1 on an error
+static inline int writeAt(int fd, const unsigned char *buffer, size_t count, uint64_t offset) {
+    size_t done = 0;
+    while (done < count) {
+        ssize_t n = pwrite(fd, buffer + done, count - done, (off_t)(offset + done));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += (size_t)n;
+    }
+    return 0;
+}
+
+#endif